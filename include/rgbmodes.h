@@ -0,0 +1,45 @@
+#ifndef RGB_MODES_H
+#define RGB_MODES_H
+#include <Arduino.h>
+#include "animation.h"
+
+/**
+ * RGB modes
+ *    constant on, 
+ *    single flash, 
+ *    double flash, 
+ *    single fade, 
+ *    double fade, 
+ *    forward shift, 
+ *    reverse shift
+ */
+enum RGBMODESTATE {
+  RGBMODE_CONSTANT = 0, 
+  RGBMODE_SINGLEFLASH, 
+  RGBMODE_DOUBLEFLASH, 
+  RGBMODE_SINGLEFADE, 
+  RGBMODE_DOUBLEFADE, 
+  RGBMODE_FORWARDSHIFT, 
+  RGBMODE_REVERSESHIFT,
+};
+/**
+ * RGB modes as keyframe animations, indexed by RGBMODESTATE
+ * step lengths and keyframe lengths are in milliseconds / steps:
+ *    constant - one full brightness step on every update
+ *    single flash - 100 ms steps; 300 ms on, 800 ms off
+ *    double flash - 50 ms steps; 150 ms on, 150 ms off, 150 ms on, 600 ms off
+ *    single fade - 5 ms steps; 400 ms rise, 400 ms fall, 205 ms off
+ *    double fade - 5 ms steps; 200 ms rise, fall, rise, fall, 205 ms off
+ *    forward/reverse shift - 100 ms steps; 4 pixels per color
+ */
+const AnimationMode RGB_MODES[] PROGMEM = {
+  {0, ANIMATION_SINGLE_COLOR, 1, {{KEYFRAME_HOLD, 1}}},
+  {100, 0, 2, {{KEYFRAME_HOLD, 3}, {KEYFRAME_OFF, 8}}},
+  {50, 0, 4, {{KEYFRAME_HOLD, 3}, {KEYFRAME_OFF, 3}, {KEYFRAME_HOLD, 3}, {KEYFRAME_OFF, 12}}},
+  {5, 0, 3, {{KEYFRAME_RAMPUP, 80}, {KEYFRAME_RAMPDOWN, 80}, {KEYFRAME_OFF, 41}}},
+  {5, 0, 5, {{KEYFRAME_RAMPUP, 40}, {KEYFRAME_RAMPDOWN, 40}, {KEYFRAME_RAMPUP, 40}, {KEYFRAME_RAMPDOWN, 40}, {KEYFRAME_OFF, 41}}},
+  {100, ANIMATION_SHIFT_FORWARD, 1, {{KEYFRAME_HOLD, 4}}},
+  {100, ANIMATION_SHIFT_REVERSE, 1, {{KEYFRAME_HOLD, 4}}},
+};
+
+#endif
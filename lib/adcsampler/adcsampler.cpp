@@ -0,0 +1,214 @@
+#include "adcsampler.h"
+
+// the sampler that gets the conversions
+static AdcSampler* activeSampler;
+
+#ifdef ESP32
+    static portMUX_TYPE samplerLock = portMUX_INITIALIZER_UNLOCKED;
+    #define SAMPLER_LOCK() portENTER_CRITICAL(&samplerLock)
+    #define SAMPLER_UNLOCK() portEXIT_CRITICAL(&samplerLock)
+#else
+    #define SAMPLER_LOCK() noInterrupts()
+    #define SAMPLER_UNLOCK() interrupts()
+#endif
+
+#ifdef __AVR__
+ISR(ADC_vect) {
+    activeSampler->conversionComplete(ADC);
+}
+#endif
+
+#ifdef ESP32
+// the task end() waits on
+static TaskHandle_t stoppingTask;
+
+/**
+ * exits between two rounds of reads, when it holds neither the ADC driver's
+ * lock nor samplerLock, and tells end() it did
+ */
+static void samplerTask(void* parameter) {
+    while (((AdcSampler*) parameter)->sampleAll()) vTaskDelay(1);
+    xTaskNotifyGive(stoppingTask);
+    vTaskDelete(NULL);
+}
+#endif
+
+#ifdef NATIVE
+// the pin the simulated ADC converts next
+static uint8_t nativeSelectedPin;
+
+static void nativeConversion() {
+    activeSampler->conversionComplete(analogRead(nativeSelectedPin));
+}
+#endif
+
+AdcSampler::AdcSampler() {
+    _numChannels = 0;
+    _channel = 0;
+    _pollTime = 0;
+    _running = false;
+    _primed = 0;
+    #ifdef ESP32
+        _task = NULL;
+        _stopping = false;
+    #endif
+}
+
+/**
+ * watch an analog pin, before begin(). the filter takes about
+ * timeConstantMillis to settle to 63% of a step. returns the channel to read
+ * the pin from; adding a pin again only sets its time constant. returns
+ * ADC_SAMPLER_NO_CHANNEL if all ADC_SAMPLER_CHANNELS channels are taken.
+ */
+uint8_t AdcSampler::addChannel(uint8_t pin, uint16_t timeConstantMillis) {
+    uint8_t channel = 0;
+    while (channel < _numChannels && _pins[channel] != pin) channel++;
+    if (channel == ADC_SAMPLER_CHANNELS) return ADC_SAMPLER_NO_CHANNEL;
+    if (channel == _numChannels) _numChannels++;
+    _pins[channel] = pin;
+    _shifts[channel] = 0;
+    while (_shifts[channel] < 12 && (ADC_SAMPLER_PERIOD << _shifts[channel]) < timeConstantMillis) _shifts[channel]++;
+    _filtered[channel] = 0;
+    _sums[channel] = 0;
+    _counts[channel] = 0;
+    return channel;
+}
+
+/**
+ * start sampling, e.g. again after end()
+ */
+void AdcSampler::begin() {
+    if (_running || !_numChannels) return;
+    _running = true;
+    activeSampler = this;
+    _channel = 0;
+    selectChannel(0);
+    #ifdef __AVR__
+        // auto trigger on timer 0 overflow, ADC clock 16 MHz / 128
+        ADCSRB = (ADCSRB & ~((1 << ADTS2) | (1 << ADTS1) | (1 << ADTS0))) | (1 << ADTS2);
+        ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+    #endif
+    #ifdef ESP32
+        _stopping = false;
+        xTaskCreatePinnedToCore(samplerTask, "adc", 2048, this, 1, &_task, xPortGetCoreID() ? 0 : 1);
+    #endif
+    #ifdef NATIVE
+        nativeAdcHook = nativeConversion;
+    #endif
+}
+
+/**
+ * stop sampling. on AVR the ADC is turned off, which it has to be to save
+ * power in sleep. on ESP32 the task is asked to stop and end() waits until
+ * it has, so analogRead() and begin() are safe afterwards.
+ */
+void AdcSampler::end() {
+    if (!_running) return;
+    _running = false;
+    #ifdef __AVR__
+        ADCSRA = 0;
+    #endif
+    #ifdef ESP32
+        stoppingTask = xTaskGetCurrentTaskHandle();
+        _stopping = true;
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        _task = NULL;
+    #endif
+    #ifdef NATIVE
+        nativeAdcHook = NULL;
+    #endif
+}
+
+/**
+ * fold the samples taken since the last call into the filtered values, at
+ * most every ADC_SAMPLER_PERIOD ms. call it from the loop.
+ * returns true if the filtered values were updated.
+ */
+bool AdcSampler::poll() {
+    if (!_running || millis() - _pollTime < ADC_SAMPLER_PERIOD) return false;
+    _pollTime = millis();
+    for (uint8_t i=0;i<_numChannels;i++) {
+        SAMPLER_LOCK();
+        uint32_t sum = _sums[i];
+        uint16_t count = _counts[i];
+        _sums[i] = 0;
+        _counts[i] = 0;
+        SAMPLER_UNLOCK();
+        if (!count) continue;
+        int32_t average = (sum << 8) / count;
+        if (!(_primed & (1 << i))) {
+            _primed |= 1 << i;
+            _filtered[i] = average;
+        }
+        else _filtered[i] += (average - (int32_t) _filtered[i]) >> _shifts[i];
+    }
+    return true;
+}
+
+/**
+ * true once a channel has a filtered value
+ */
+bool AdcSampler::ready(uint8_t channel) {
+    return channel < _numChannels && (_primed & (1 << channel));
+}
+
+/**
+ * filtered value of a channel, 0 to ADC_SAMPLER_MAX
+ */
+uint16_t AdcSampler::read(uint8_t channel) {
+    if (channel >= _numChannels) return 0;
+    return (_filtered[channel] + 128) >> 8;
+}
+
+/**
+ * a conversion of the selected channel finished: add it to the channel's
+ * samples and select the next channel. called from the ADC interrupt.
+ */
+void AdcSampler::conversionComplete(uint16_t value) {
+    uint8_t channel = _channel;
+    addSample(channel, value);
+    if (_numChannels == 1) return;
+    channel = channel + 1 < _numChannels ? channel + 1 : 0;
+    _channel = channel;
+    selectChannel(channel);
+}
+
+/**
+ * read every channel once. called from the sampler task on ESP32.
+ * returns false instead once end() asked the task to stop.
+ */
+bool AdcSampler::sampleAll() {
+    #ifdef ESP32
+        if (_stopping) return false;
+    #endif
+    for (uint8_t i=0;i<_numChannels;i++) {
+        uint16_t value = analogRead(_pins[i]);
+        SAMPLER_LOCK();
+        addSample(i, value);
+        SAMPLER_UNLOCK();
+    }
+    return true;
+}
+
+void AdcSampler::addSample(uint8_t channel, uint16_t value) {
+    // stop summing if poll() doesn't come, so the sum can't overflow
+    if (_counts[channel] >= 1024) return;
+    _sums[channel] += value;
+    _counts[channel]++;
+}
+
+/**
+ * point the ADC at a channel's pin for the next conversion
+ */
+void AdcSampler::selectChannel(uint8_t channel) {
+    #ifdef __AVR__
+        uint8_t mux = _pins[channel] >= A0 ? _pins[channel] - A0 : _pins[channel];
+        ADMUX = (1 << REFS0) | (mux & 0x07);
+        #ifdef MUX5
+            ADCSRB = (ADCSRB & ~(1 << MUX5)) | ((mux >> 3) << MUX5);
+        #endif
+    #endif
+    #ifdef NATIVE
+        nativeSelectedPin = _pins[channel];
+    #endif
+}
@@ -0,0 +1,68 @@
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+#include <Arduino.h>
+
+// analog pins one sampler can watch, each costs 12 bytes of RAM
+#ifndef ADC_SAMPLER_CHANNELS
+    #define ADC_SAMPLER_CHANNELS 4
+#endif
+// addChannel() when all channels are taken; never ready() and read as 0
+#define ADC_SAMPLER_NO_CHANNEL 0xFF
+// how often poll() folds the new samples into the filtered values, in ms
+#define ADC_SAMPLER_PERIOD 16
+// largest ADC reading
+#ifdef ESP32
+    #define ADC_SAMPLER_MAX 4095
+#else
+    #define ADC_SAMPLER_MAX 1023
+#endif
+
+/**
+ * Samples analog pins in the background and low-pass filters them.
+ *
+ * Conversions never block the loop. On AVR the ADC is triggered by the
+ * timer 0 overflow that also drives millis(), about 1000 times a second,
+ * and its interrupt moves on to the next channel. On ESP32 a task on the
+ * core the loop doesn't run on reads the channels every tick. The samples
+ * are only summed there; poll() turns them into filtered values every
+ * ADC_SAMPLER_PERIOD ms, with an exponential filter of the time constant
+ * each channel was added with.
+ *
+ * While the sampler runs, analogRead() must not be used, and on AVR only
+ * one sampler can run.
+ */
+class AdcSampler {
+    public:
+        AdcSampler();
+        uint8_t addChannel(uint8_t pin, uint16_t timeConstantMillis);
+        void begin();
+        void end();
+        bool poll();
+        bool ready(uint8_t channel);
+        uint16_t read(uint8_t channel);
+        void conversionComplete(uint16_t value);
+        bool sampleAll();
+    private:
+        void addSample(uint8_t channel, uint16_t value);
+        void selectChannel(uint8_t channel);
+        uint8_t _numChannels;
+        uint8_t _pins[ADC_SAMPLER_CHANNELS];
+        uint8_t _shifts[ADC_SAMPLER_CHANNELS];
+        // filtered values in 1/256 counts, 0 until the first poll() with samples
+        uint32_t _filtered[ADC_SAMPLER_CHANNELS];
+        // samples since the last poll(), written by the interrupt or task
+        volatile uint32_t _sums[ADC_SAMPLER_CHANNELS];
+        volatile uint16_t _counts[ADC_SAMPLER_CHANNELS];
+        volatile uint8_t _channel;
+        // channels with a filtered value, one bit each
+        uint8_t _primed;
+        unsigned long _pollTime;
+        bool _running;
+        #ifdef ESP32
+            TaskHandle_t _task;
+            // set by end() for the task to exit
+            volatile bool _stopping;
+        #endif
+};
+
+#endif
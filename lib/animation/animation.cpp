@@ -0,0 +1,258 @@
+#include "animation.h"
+#include "envelopes.h"
+
+Palette::Palette(ColorFunc colorFunc) {
+    _colorFunc = colorFunc;
+    _numColors = 0;
+    _brightnessVal = 0;
+    _valid = false;
+}
+
+/**
+ * convert the colors if they or the brightness value changed since the last
+ * update. returns true if they were converted.
+ */
+bool Palette::update(const uint8_t* colors, uint8_t numColors, uint8_t brightnessVal) {
+    if (numColors > PALETTE_MAX_COLORS) numColors = PALETTE_MAX_COLORS;
+    const uint8_t converted = numColors ? numColors : 1;
+    if (_valid && numColors == _numColors && brightnessVal == _brightnessVal
+        && !memcmp(colors, _indices, converted)) return false;
+    memcpy(_indices, colors, converted);
+    for (uint8_t i=0;i<converted;i++) _colors[i] = _colorFunc(colors[i], brightnessVal);
+    _numColors = numColors;
+    _brightnessVal = brightnessVal;
+    _valid = true;
+    return true;
+}
+
+const CRGB* Palette::getColors() {
+    return _colors;
+}
+
+uint8_t Palette::getNumColors() {
+    return _numColors;
+}
+
+AnimationEngine::AnimationEngine() {
+    _modeSrc = NULL;
+    _ring = NULL;
+    _ringLen = 0;
+    _ringStart = 0;
+    memset(_ringSums, 0, sizeof(_ringSums));
+    _color = CRGB(0, 0, 0);
+    _mode.numKeyframes = 0;
+    _nextStep = 0;
+    _colorIndex = 0;
+    _cycleDone = false;
+    memset(_dither, 0, sizeof(_dither));
+    startKeyframe(0);
+}
+
+/**
+ * select the mode to animate, a pointer to an AnimationMode in PROGMEM.
+ * the mode is copied to RAM once. when it changes, its cycle restarts from the
+ * first color with its first step due now, so nothing carries over from the
+ * mode before.
+ */
+void AnimationEngine::setMode(const AnimationMode* mode) {
+    if (mode == _modeSrc) return;
+    _modeSrc = mode;
+    memcpy_P(&_mode, mode, sizeof(AnimationMode));
+    if (_mode.numKeyframes > MAX_KEYFRAMES) _mode.numKeyframes = MAX_KEYFRAMES;
+    startKeyframe(0);
+    _colorIndex = 0;
+    _cycleDone = false;
+    memset(_dither, 0, sizeof(_dither));
+    _nextStep = millis();
+}
+
+/**
+ * ring buffer holding the pixels of the shift modes, one per LED
+ */
+void AnimationEngine::setShiftBuffer(CRGB* ring, int len) {
+    _ring = ring;
+    _ringLen = len;
+    _ringStart = 0;
+    memset(_ringSums, 0, sizeof(_ringSums));
+    for (int i=0;i<len;i++) {
+        for (uint8_t c=0;c<3;c++) _ringSums[c] += ring[i][c];
+    }
+}
+
+void AnimationEngine::setRingPixel(int index, const CRGB& color) {
+    CRGB& pixel = _ring[index];
+    for (uint8_t c=0;c<3;c++) _ringSums[c] += color[c] - pixel[c];
+    pixel = color;
+}
+
+/**
+ * a ramp covers 64 steps of RAMP_TABLE, so it advances 64 * 256 / steps
+ * phase units a step; the division is done once here
+ */
+void AnimationEngine::startKeyframe(uint8_t keyframe) {
+    _keyframe = keyframe;
+    _pos = 0;
+    _rampPhase = 0;
+    _rampRem = 0;
+    _rampInc = 0;
+    _rampIncRem = 0;
+    if (keyframe < _mode.numKeyframes) {
+        const uint8_t steps = _mode.keyframes[keyframe].steps ? _mode.keyframes[keyframe].steps : 1;
+        _rampInc = (64 << 8) / steps;
+        _rampIncRem = (64 << 8) % steps;
+    }
+}
+
+/**
+ * full scale brightness of the current step, 16 bit and gamma corrected,
+ * then advance one step. ramps walk RAMP_TABLE with an integer DDA and
+ * interpolate between its entries; after the last keyframe the cycle starts over.
+ */
+uint16_t AnimationEngine::step() {
+    _cycleDone = false;
+    if (!_mode.numKeyframes) {
+        _cycleDone = true;
+        return 0;
+    }
+    const Keyframe& keyframe = _mode.keyframes[_keyframe];
+    const uint8_t steps = keyframe.steps ? keyframe.steps : 1;
+    uint16_t level;
+    switch (keyframe.type) {
+        case KEYFRAME_HOLD:
+            level = 65535;
+            break;
+        case KEYFRAME_RAMPUP:
+            level = envelopeBetween<RAMP_TABLE>(_rampPhase >> 8, _rampPhase & 0xFF);
+            break;
+        case KEYFRAME_RAMPDOWN:
+            level = envelopeBetween<RAMP_TABLE>((_rampPhase >> 8) + 64, _rampPhase & 0xFF);
+            break;
+        default:
+            level = 0;
+    }
+    _pos++;
+    _rampPhase += _rampInc;
+    _rampRem += _rampIncRem;
+    if (_rampRem >= steps) {
+        _rampRem -= steps;
+        _rampPhase++;
+    }
+    if (_pos >= steps) {
+        if (_keyframe + 1 >= _mode.numKeyframes) {
+            startKeyframe(0);
+            _cycleDone = true;
+        }
+        else startKeyframe(_keyframe + 1);
+    }
+    return level;
+}
+
+/**
+ * scale a color by a 16 bit level and round it to 8 bits with temporal
+ * dithering: the part of each channel below 8 bits is carried over to the
+ * next call, so over a few frames the output averages out to the 16 bit color.
+ * full and zero levels come out exact.
+ */
+CRGB AnimationEngine::dither(const CRGB& color, uint16_t level) {
+    CRGB out;
+    for (uint8_t c=0;c<3;c++) {
+        // 8.8 fixed point, at most 0xFF00 so the carry fits
+        const uint16_t value = ((uint32_t) color[c] * ((uint32_t) level + 1)) >> 8;
+        const uint16_t dithered = value + _dither[c];
+        out[c] = dithered >> 8;
+        _dither[c] = dithered & 0xFF;
+    }
+    return out;
+}
+
+/**
+ * advance the animation by the steps that came due. returns true if any step
+ * was taken, so the frame is due to be rendered, even if it looks the same.
+ * palette - pixel colors at the brightness to show, e.g. from Palette::getColors()
+ * steps are due every stepMillis from the time the mode was set, not from the
+ * last update, so updates that come late don't stretch the animation: after a
+ * stall, the steps missed are taken at once and only the last one is shown.
+ * after a stall of more than ANIMATION_MAX_CATCHUP steps, e.g. while the LEDs
+ * were off, only ANIMATION_MAX_CATCHUP steps are taken and the rest are
+ * dropped, and the schedule starts over from now.
+ */
+bool AnimationEngine::update(const CRGB* palette, uint8_t numColors) {
+    uint8_t steps = 1;
+    if (_mode.stepMillis) {
+        const unsigned long now = millis();
+        if ((long)(now - _nextStep) < 0) return false;
+        _nextStep += _mode.stepMillis;
+        while ((long)(now - _nextStep) >= 0) {
+            if (steps == ANIMATION_MAX_CATCHUP) {
+                _nextStep = now + _mode.stepMillis;
+                break;
+            }
+            steps++;
+            _nextStep += _mode.stepMillis;
+        }
+    }
+    for (uint8_t i=1;i<steps;i++) advance(palette, numColors, false);
+    advance(palette, numColors, true);
+    return true;
+}
+
+/**
+ * take one step. the color is worked out for the step that is shown, and for
+ * every step of the shift modes, which leave each step's pixel in the ring.
+ */
+void AnimationEngine::advance(const CRGB* palette, uint8_t numColors, bool shown) {
+    const uint16_t level = step();
+    const bool shift = _ringLen && (_mode.flags & ANIMATION_SHIFT);
+    const bool colored = shown || shift;
+
+    CRGB color;
+    if (_mode.flags & ANIMATION_SINGLE_COLOR) {
+        if (colored) color = palette[0];
+    }
+    else {
+        // single colors in shift modes are chased with black
+        const bool chase = (_mode.flags & ANIMATION_SHIFT) && numColors <= 1;
+        const uint8_t count = chase ? 2 : (numColors ? numColors : 1);
+        if (_colorIndex >= count) _colorIndex = 0;
+        if (colored) color = (chase && _colorIndex) ? CRGB(0, 0, 0) : palette[_colorIndex];
+        if (_cycleDone) _colorIndex++;
+    }
+    if (!colored) return;
+    _color = dither(color, level);
+
+    if (_ringLen && (_mode.flags & ANIMATION_SHIFT_FORWARD)) {
+        // shift LEDs with the flow of data: the new pixel becomes the first pixel
+        _ringStart = _ringStart ? _ringStart - 1 : _ringLen - 1;
+        setRingPixel(_ringStart, _color);
+    }
+    else if (_ringLen && (_mode.flags & ANIMATION_SHIFT_REVERSE)) {
+        // shift LEDs against the flow of data: the new pixel replaces the first
+        // pixel and becomes the last one
+        setRingPixel(_ringStart, _color);
+        _ringStart = _ringStart + 1 < _ringLen ? _ringStart + 1 : 0;
+    }
+}
+
+/**
+ * write the current frame into leds, the ring unrolled from its start offset
+ * for shift modes, else the current color on every pixel
+ */
+void AnimationEngine::render(CRGB* leds, int numLeds) {
+    if (!(_mode.flags & ANIMATION_SHIFT) || !_ringLen) {
+        fill_solid(leds, numLeds, _color);
+        return;
+    }
+    const int len = numLeds < _ringLen ? numLeds : _ringLen;
+    const int head = _ringLen - _ringStart < len ? _ringLen - _ringStart : len;
+    memcpy(&leds[0], &_ring[_ringStart], head * sizeof(CRGB));
+    memcpy(&leds[head], &_ring[0], (len - head) * sizeof(CRGB));
+}
+
+/**
+ * red, green and blue summed over the frame render() writes to numLeds LEDs.
+ * for shift modes numLeds has to be the ring length.
+ */
+void AnimationEngine::getChannelSums(int numLeds, uint32_t sums[3]) {
+    const bool shift = (_mode.flags & ANIMATION_SHIFT) && _ringLen;
+    for (uint8_t c=0;c<3;c++) sums[c] = shift ? _ringSums[c] : (uint32_t) _color[c] * numLeds;
+}
@@ -0,0 +1,129 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+#include <Arduino.h>
+#include "FastLED.h"
+
+/**
+ * Keyframe animation engine for the RGB modes.
+ * A mode is a list of keyframes, each a brightness shape held for a number of
+ * steps of stepMillis milliseconds. One pass over all keyframes is a cycle, and
+ * the color advances to the next color of the palette after every cycle.
+ *    KEYFRAME_HOLD - full brightness
+ *    KEYFRAME_RAMPUP - sine fade from off to full brightness
+ *    KEYFRAME_RAMPDOWN - sine fade from full brightness to off
+ *    KEYFRAME_OFF - off
+ */
+enum KEYFRAMETYPE {
+    KEYFRAME_HOLD = 0,
+    KEYFRAME_RAMPUP,
+    KEYFRAME_RAMPDOWN,
+    KEYFRAME_OFF,
+};
+
+/**
+ * animation flags
+ *    ANIMATION_SINGLE_COLOR - only show the first color of the palette
+ *    ANIMATION_SHIFT_FORWARD - shift a new pixel in at the start of the strip every step
+ *    ANIMATION_SHIFT_REVERSE - shift a new pixel in at the end of the strip every step
+ * shift modes with a single color chase it with black.
+ * shift modes keep their pixels in a ring buffer given to setShiftBuffer().
+ * a step writes one pixel and moves the ring's start offset, so its cost does
+ * not depend on the strip length; render() unrolls the ring into the frame.
+ * the channel sums of the ring are updated with the pixel it overwrites, so
+ * getChannelSums() doesn't read the ring either.
+ * levels are 16 bit and gamma corrected; the frame color is the palette color
+ * scaled by the level and dithered down to 8 bits over time, so slow fades at
+ * a low brightness don't staircase.
+ */
+#define ANIMATION_SINGLE_COLOR 0x01
+#define ANIMATION_SHIFT_FORWARD 0x02
+#define ANIMATION_SHIFT_REVERSE 0x04
+#define ANIMATION_SHIFT (ANIMATION_SHIFT_FORWARD | ANIMATION_SHIFT_REVERSE)
+
+#define MAX_KEYFRAMES 6
+// colors a Palette holds, as many as a preset
+#define PALETTE_MAX_COLORS 10
+// most steps update() catches up on after a stall
+#define ANIMATION_MAX_CATCHUP 64
+
+struct Keyframe {
+    uint8_t type;
+    uint8_t steps;
+};
+
+/**
+ * stepMillis - length of an animation step, 0 steps on every update
+ * flags - ANIMATION_* flags
+ * numKeyframes - number of keyframes used in keyframes
+ */
+struct AnimationMode {
+    uint8_t stepMillis;
+    uint8_t flags;
+    uint8_t numKeyframes;
+    Keyframe keyframes[MAX_KEYFRAMES];
+};
+
+/**
+ * maps a palette color and a brightness value to the pixel color
+ */
+typedef CRGB (*ColorFunc)(uint8_t color, uint8_t brightnessVal);
+
+/**
+ * Palette colors converted to pixel colors at a brightness value.
+ * update() only converts them again when the colors or the brightness value
+ * changed, so the animation's steps look their color up instead of converting
+ * it. An empty palette still converts its first color, which the engine shows.
+ */
+class Palette {
+    public:
+        Palette(ColorFunc colorFunc);
+        bool update(const uint8_t* colors, uint8_t numColors, uint8_t brightnessVal);
+        const CRGB* getColors();
+        uint8_t getNumColors();
+    private:
+        ColorFunc _colorFunc;
+        CRGB _colors[PALETTE_MAX_COLORS];
+        uint8_t _indices[PALETTE_MAX_COLORS];
+        uint8_t _numColors;
+        uint8_t _brightnessVal;
+        bool _valid;
+};
+
+class AnimationEngine {
+    public:
+        AnimationEngine();
+        void setMode(const AnimationMode* mode);
+        void setShiftBuffer(CRGB* ring, int len);
+        bool update(const CRGB* palette, uint8_t numColors);
+        void render(CRGB* leds, int numLeds);
+        void getChannelSums(int numLeds, uint32_t sums[3]);
+        uint16_t step();
+        CRGB dither(const CRGB& color, uint16_t level);
+    private:
+        void startKeyframe(uint8_t keyframe);
+        void advance(const CRGB* palette, uint8_t numColors, bool shown);
+        void setRingPixel(int index, const CRGB& color);
+        const AnimationMode* _modeSrc;
+        AnimationMode _mode;
+        CRGB _color;
+        CRGB* _ring;
+        int _ringLen;
+        int _ringStart;
+        uint32_t _ringSums[3];
+        // millis() the next step is due at
+        unsigned long _nextStep;
+        uint8_t _keyframe;
+        uint8_t _pos;
+        // position on the ramp in 1/256 steps of RAMP_TABLE, advanced by
+        // _rampInc and _rampIncRem / steps every step
+        uint16_t _rampPhase;
+        uint16_t _rampInc;
+        uint8_t _rampIncRem;
+        uint8_t _rampRem;
+        // the part of each channel below 8 bits not shown yet
+        uint8_t _dither[3];
+        uint8_t _colorIndex;
+        bool _cycleDone;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#include "battery.h"
+
+/**
+ * fullScaleMillivolts - pack voltage that reads as ADC_SAMPLER_MAX through the divider
+ */
+BatteryMonitor::BatteryMonitor(AdcSampler& sampler, uint8_t pin, uint16_t fullScaleMillivolts)
+    : _sampler(sampler) {
+    _pin = pin;
+    _channel = 0;
+    _fullScaleMillivolts = fullScaleMillivolts;
+    _numSteps = 0;
+    _recoverMillivolts = 0;
+    _millivolts = 0;
+    _step = 0;
+    _updateTime = 0;
+}
+
+/**
+ * add the pin to the sampler, before the sampler's begin()
+ */
+void BatteryMonitor::begin(uint16_t timeConstantMillis) {
+    _channel = _sampler.addChannel(_pin, timeConstantMillis);
+}
+
+/**
+ * stepMillivolts - in PROGMEM
+ */
+void BatteryMonitor::setSteps(const uint16_t* stepMillivolts, uint8_t numSteps, uint16_t recoverMillivolts) {
+    _numSteps = numSteps < BATTERY_MAX_STEPS ? numSteps : BATTERY_MAX_STEPS;
+    memcpy_P(_stepMillivolts, stepMillivolts, _numSteps * sizeof(uint16_t));
+    _recoverMillivolts = recoverMillivolts;
+}
+
+/**
+ * read the filtered voltage every BATTERY_UPDATE_INTERVAL ms.
+ * returns true if the step changed.
+ */
+bool BatteryMonitor::update() {
+    if (millis() - _updateTime < BATTERY_UPDATE_INTERVAL) return false;
+    _updateTime = millis();
+    if (!_sampler.ready(_channel)) return false;
+    _millivolts = (uint32_t) _sampler.read(_channel) * _fullScaleMillivolts / ADC_SAMPLER_MAX;
+    uint8_t step = _step;
+    if (_millivolts < BATTERY_MISSING_MILLIVOLTS) {
+        step = 0;
+    } else {
+        while (step < _numSteps && _millivolts < _stepMillivolts[step]) step++;
+        while (step > 0 && _millivolts >= _stepMillivolts[step - 1] + _recoverMillivolts) step--;
+    }
+    if (step == _step) return false;
+    _step = step;
+    return true;
+}
+
+/**
+ * filtered pack voltage, in mV
+ */
+uint16_t BatteryMonitor::getMillivolts() {
+    return _millivolts;
+}
+
+/**
+ * 0 while the pack is above the first step voltage, or missing
+ */
+uint8_t BatteryMonitor::getStep() {
+    return _step;
+}
@@ -0,0 +1,43 @@
+#ifndef BATTERY_H
+#define BATTERY_H
+#include <Arduino.h>
+#include "adcsampler.h"
+
+// how often update() looks at the voltage, in ms
+#define BATTERY_UPDATE_INTERVAL 500
+// below this the pack is taken to be missing, e.g. when running off USB, in mV
+#define BATTERY_MISSING_MILLIVOLTS 5000
+// steps derated at most
+#define BATTERY_MAX_STEPS 4
+
+/**
+ * Pack voltage from an AdcSampler channel behind a voltage divider, and the
+ * derating step it calls for.
+ *
+ * The step is the number of step voltages the pack is below, so the step
+ * voltages go from high to low. The pack sags under load and recovers when
+ * the lights are derated, so a step is only taken back once the pack is
+ * recoverMillivolts above its step voltage, e.g. on a charger.
+ */
+class BatteryMonitor {
+    public:
+        BatteryMonitor(AdcSampler& sampler, uint8_t pin, uint16_t fullScaleMillivolts);
+        void begin(uint16_t timeConstantMillis);
+        void setSteps(const uint16_t* stepMillivolts, uint8_t numSteps, uint16_t recoverMillivolts);
+        bool update();
+        uint16_t getMillivolts();
+        uint8_t getStep();
+    private:
+        AdcSampler& _sampler;
+        uint8_t _pin;
+        uint8_t _channel;
+        uint16_t _fullScaleMillivolts;
+        uint16_t _stepMillivolts[BATTERY_MAX_STEPS];
+        uint8_t _numSteps;
+        uint16_t _recoverMillivolts;
+        uint16_t _millivolts;
+        uint8_t _step;
+        unsigned long _updateTime;
+};
+
+#endif
@@ -1,12 +1,26 @@
 #include "buttonlib2.h"
 
+ButtonGesture::ButtonGesture() {
+    _debounceDelay = DEBOUNCE_DELAY;
+    _multiclickDuration = MULTICLICK_DURATION;
+    _longclickDuration = LONGCLICK_DURATION;
+    _curState = HIGH;
+    _rawState = HIGH;
+    _rawTime = 0;
+    _lastClickTime = 0;
+    _numClicks = 0;
+    for (int i=0;i<MAX_CLICKS;i++) {
+        _shortPressFuncs[i] = NULL;
+        _longPressFuncs[i] = NULL;
+    }
+}
+
 InterruptButton::InterruptButton(int pin) {
     _pin = pin;
 }
 
-void InterruptButton::changeInterruptFunc() {
-    _changed = true;
-    _lastDebounceTime = millis();
+void IRAM_ATTR InterruptButton::changeInterruptFunc() {
+    _edges.push(millis(), digitalRead(_pin));
 }
 
 // void InterruptButton::setChangeInterruptFunc(void (*changeInterruptFunc)()) {
@@ -15,96 +29,197 @@ void InterruptButton::changeInterruptFunc() {
 
 void InterruptButton::begin(void (*changeInterruptFunc)()) {
     pinMode(_pin, INPUT_PULLUP);
+    resync(millis(), digitalRead(_pin));
     attachInterrupt(digitalPinToInterrupt(_pin), changeInterruptFunc, CHANGE);
 }
 
-void InterruptButton::set1ShortPressFunc(void (*func)()) {
-    _1ShortPressFunc = func;
+void ButtonGesture::set1ShortPressFunc(void (*func)()) {
+    _shortPressFuncs[0] = func;
+}
+
+void ButtonGesture::set2ShortPressFunc(void (*func)()) {
+    _shortPressFuncs[1] = func;
 }
 
-void InterruptButton::set2ShortPressFunc(void (*func)()) {
-    _2ShortPressFunc = func;
+void ButtonGesture::set3ShortPressFunc(void (*func)()) {
+    _shortPressFuncs[2] = func;
 }
 
-void InterruptButton::set3ShortPressFunc(void (*func)()) {
-    _3ShortPressFunc = func;
+void ButtonGesture::set1LongPressFunc(void (*func)()) {
+    _longPressFuncs[0] = func;
 }
 
-void InterruptButton::set1LongPressFunc(void (*func)()) {
-    _1LongPressFunc = func;
+void ButtonGesture::set2LongPressFunc(void (*func)()) {
+    _longPressFuncs[1] = func;
 }
 
-void InterruptButton::set2LongPressFunc(void (*func)()) {
-    _2LongPressFunc = func;
+void ButtonGesture::set3LongPressFunc(void (*func)()) {
+    _longPressFuncs[2] = func;
 }
 
-void InterruptButton::set3LongPressFunc(void (*func)()) {
-    _3LongPressFunc = func;
+/**
+ * debounceDelay - time a level has to be stable to count
+ * multiclickDuration - time after a press within which another press adds a click
+ * longclickDuration - time a press has to be held to be a long press
+ */
+void ButtonGesture::setTimings(uint16_t debounceDelay, uint16_t multiclickDuration, uint16_t longclickDuration) {
+    _debounceDelay = debounceDelay;
+    _multiclickDuration = multiclickDuration;
+    _longclickDuration = longclickDuration;
 }
 
+/**
+ * true if the button is released and no gesture is in progress
+ */
+bool ButtonGesture::idle() {
+    return !_numClicks && _curState && _rawState;
+}
+
+/**
+ * replay the queued edges, then bring the button up to the current time
+ */
 void InterruptButton::loop() {
-    if (_changed && millis() - _lastDebounceTime > DEBOUNCE_DELAY) {
-        _curState = digitalRead(_pin);
-        /**
-         * when pressed, increment the btn click count if within the multiclick delay.
-         */
+    ButtonEdge queued;
+    while (_edges.pop(queued)) edge(queued.time, queued.level);
+    // edges were dropped, so resync with the pin; a level that didn't change is no edge
+    if (_edges.overflowed()) {
+        bool level = digitalRead(_pin);
+        if (level != _rawState) edge(millis(), level);
+    }
+    advance(millis());
+}
+
+/**
+ * take the level as the button's state without a gesture, e.g. at startup
+ */
+void ButtonGesture::resync(unsigned long time, bool level) {
+    _curState = level;
+    _rawState = level;
+    _rawTime = time;
+    _numClicks = 0;
+}
+
+/**
+ * an edge of the pin, in time order
+ */
+void ButtonGesture::edge(unsigned long time, bool level) {
+    advance(time);
+    _rawState = level;
+    _rawTime = time;
+}
+
+/**
+ * run debouncing and click detection up to a point in time.
+ * a level counts once it was stable for the debounce delay, and a press counts
+ * from the edge that started it.
+ */
+void ButtonGesture::advance(unsigned long time) {
+    if (_rawState != _curState && time - _rawTime > _debounceDelay) {
+        _curState = _rawState;
         if (!_curState) {
-            // Serial.print("btn pressed ");
-            _lastClickTime = millis();
-            _numClicks++;
+            _lastClickTime = _rawTime;
+            if (_numClicks < MAX_CLICKS) _numClicks++;
+        } else if (_numClicks && !moreClicksMatter()) {
+            dispatch(_shortPressFuncs);
         }
-        // else Serial.print("btn released ");
-        _changed = false;
     }
 
-    if (_numClicks) {
-        if (millis() - _lastClickTime > MULTICLICK_DURATION) {
-            if (digitalRead(_pin)) {
-                // Serial.print("button clicked ");
-                // Serial.print(_numClicks);
-                // Serial.println(" times.");
-                switch (_numClicks) {
-                    case 1: 
-                        if (_1ShortPressFunc != NULL) {
-                            _1ShortPressFunc();
-                            break;
-                        }             
-                    case 2: 
-                    if (_2ShortPressFunc != NULL) {
-                        _2ShortPressFunc();
-                        break;
-                    }
-                    default: 
-                    if (_3ShortPressFunc != NULL) {
-                        _3ShortPressFunc();
-                    }
-                }
-                _numClicks = 0; 
-            }
+    if (!_numClicks) return;
+    if (_curState) {
+        if (time - _lastClickTime > _multiclickDuration) dispatch(_shortPressFuncs);
+    } else {
+        if (time - _lastClickTime > _longclickDuration) dispatch(_longPressFuncs);
+    }
+}
+
+/**
+ * true if another press could still end in a handler
+ */
+bool ButtonGesture::moreClicksMatter() {
+    uint8_t next = _numClicks < MAX_CLICKS ? _numClicks : MAX_CLICKS - 1;
+    for (uint8_t i=next;i<MAX_CLICKS;i++) {
+        if (_shortPressFuncs[i] != NULL || _longPressFuncs[i] != NULL) return true;
+    }
+    return false;
+}
+
+/**
+ * call the handler for the current click count and start a new gesture
+ */
+void ButtonGesture::dispatch(void (*const funcs[MAX_CLICKS])()) {
+    void (*func)() = funcs[_numClicks - 1];
+    _numClicks = 0;
+    if (func != NULL) func();
+}
+
+GroupButton::GroupButton(int pin) {
+    _pin = pin;
+    _mask = digitalPinToBitMask(pin);
+    _port = portInputRegister(digitalPinToPort(pin));
+}
+
+ButtonGroup::ButtonGroup(GroupButton* buttons, uint8_t numButtons) {
+    _buttons = buttons;
+    _numButtons = numButtons < MAX_GROUP_BUTTONS ? numButtons : MAX_GROUP_BUTTONS;
+}
+
+void ButtonGroup::begin(void (*changeInterruptFunc)()) {
+    for (uint8_t i=0;i<_numButtons;i++) pinMode(_buttons[i]._pin, INPUT_PULLUP);
+    uint8_t levels = readLevels();
+    unsigned long now = millis();
+    for (uint8_t i=0;i<_numButtons;i++) {
+        GroupButton& button = _buttons[i];
+        button.resync(now, levels & (1 << i));
+        #ifdef __AVR__
+            *digitalPinToPCICR(button._pin) |= _BV(digitalPinToPCICRbit(button._pin));
+            *digitalPinToPCMSK(button._pin) |= _BV(digitalPinToPCMSKbit(button._pin));
+        #else
+            attachInterrupt(digitalPinToInterrupt(button._pin), changeInterruptFunc, CHANGE);
+        #endif
+    }
+}
+
+/**
+ * levels of all buttons, bit i for button i
+ */
+uint8_t IRAM_ATTR ButtonGroup::readLevels() {
+    uint8_t levels = 0;
+    PortRegister* port = NULL;
+    PortMask value = 0;
+    for (uint8_t i=0;i<_numButtons;i++) {
+        GroupButton& button = _buttons[i];
+        if (button._port != port) {
+            port = button._port;
+            value = *port;
         }
-        if (millis() - _lastClickTime > LONGCLICK_DURATION) {
-            if (!digitalRead(_pin)) {
-                // Serial.print("button long clicked ");
-                // Serial.print(_numClicks);
-                // Serial.println(" times.");
-                switch (_numClicks) {
-                    case 1: 
-                        if (_1LongPressFunc != NULL) {
-                            _1LongPressFunc();
-                            break;
-                        }
-                    case 2: 
-                        if (_2LongPressFunc != NULL) {
-                            _2LongPressFunc();
-                            break;   
-                        }
-                    default: 
-                        if (_3LongPressFunc != NULL) {
-                            _3LongPressFunc();
-                        }
-                }
-                _numClicks = 0; 
-            }
+        if (value & button._mask) levels |= 1 << i;
+    }
+    return levels;
+}
+
+void IRAM_ATTR ButtonGroup::changeInterruptFunc() {
+    _edges.push(millis(), readLevels());
+}
+
+/**
+ * replay the queued edges into the buttons whose level changed, then bring
+ * all buttons up to the current time
+ */
+void ButtonGroup::loop() {
+    ButtonEdge queued;
+    while (_edges.pop(queued)) {
+        for (uint8_t i=0;i<_numButtons;i++) {
+            bool level = queued.level & (1 << i);
+            if (level != _buttons[i]._rawState) _buttons[i].edge(queued.time, level);
+        }
+    }
+    if (_edges.overflowed()) {
+        uint8_t levels = readLevels();
+        for (uint8_t i=0;i<_numButtons;i++) {
+            bool level = levels & (1 << i);
+            if (level != _buttons[i]._rawState) _buttons[i].edge(millis(), level);
         }
     }
+    unsigned long now = millis();
+    for (uint8_t i=0;i<_numButtons;i++) _buttons[i].advance(now);
 }
\ No newline at end of file
@@ -2,41 +2,188 @@
 #define INTERRUPT_BUTTON_H
 #include <Arduino.h>
 
+#ifndef IRAM_ATTR
+    #define IRAM_ATTR
+#endif
+
+// default timings in ms, see InterruptButton::setTimings()
 #define DEBOUNCE_DELAY 50
 #define MULTICLICK_DURATION 500
 #define LONGCLICK_DURATION 1000
+// click counts with a handler of their own, higher counts use the last one
+#define MAX_CLICKS 3
+// edges the ISR can queue between two loop() calls, a power of two
+#define EDGE_QUEUE_SIZE 16
 /**
  * short click: single, double, triple
  * long press: single, double, triple
  */
 
+/**
+ * pin level read by the change interrupt and the millis() it was read at.
+ * for a ButtonGroup, level holds one bit per button.
+ */
+struct ButtonEdge {
+    unsigned long time;
+    uint8_t level;
+};
 
-class InterruptButton {
+/**
+ * Fixed-size single-producer/single-consumer queue of edges.
+ * The change interrupt pushes and loop() pops. Each side only writes its own
+ * index, so no locking is needed. When the queue is full, new edges are
+ * dropped and overflowed() reports it once.
+ */
+class EdgeQueue {
     public:
-        InterruptButton(int pin);
-        // void setChangeInterruptFunc(void (*changeInterruptFunc)());
-        void begin(void (*changeInterruptFunc)());
-        void changeInterruptFunc();
+        EdgeQueue() : _head(0), _tail(0), _overflow(false) {}
+
+        void IRAM_ATTR push(unsigned long time, uint8_t level) {
+            uint8_t head = _head;
+            if ((uint8_t)(head - _tail) == EDGE_QUEUE_SIZE) {
+                _overflow = true;
+                return;
+            }
+            _edges[head & (EDGE_QUEUE_SIZE - 1)].time = time;
+            _edges[head & (EDGE_QUEUE_SIZE - 1)].level = level;
+            _head = head + 1;
+        }
+
+        bool pop(ButtonEdge& edge) {
+            uint8_t tail = _tail;
+            if (tail == _head) return false;
+            edge.time = _edges[tail & (EDGE_QUEUE_SIZE - 1)].time;
+            edge.level = _edges[tail & (EDGE_QUEUE_SIZE - 1)].level;
+            _tail = tail + 1;
+            return true;
+        }
+
+        bool overflowed() {
+            if (!_overflow) return false;
+            _overflow = false;
+            return true;
+        }
+
+    private:
+        volatile ButtonEdge _edges[EDGE_QUEUE_SIZE];
+        volatile uint8_t _head;
+        volatile uint8_t _tail;
+        volatile bool _overflow;
+};
+
+/**
+ * Debouncing and gesture recognition of one button, fed with timestamped
+ * edges by InterruptButton or ButtonGroup.
+ *
+ * A gesture is dispatched as soon as no registered handler could still match
+ * a longer one: a click fires on release unless a handler for more clicks or a
+ * long press after more clicks is set, and otherwise after the multi-click
+ * window. N clicks call the handler for N clicks, or nothing if it isn't set.
+ */
+class ButtonGesture {
+    public:
+        ButtonGesture();
         void set1ShortPressFunc(void (*func)() = NULL);
         void set2ShortPressFunc(void (*func)() = NULL);
         void set3ShortPressFunc(void (*func)() = NULL);
         void set1LongPressFunc(void (*func)() = NULL);
         void set2LongPressFunc(void (*func)() = NULL);
         void set3LongPressFunc(void (*func)() = NULL);
-        void loop();
+        void setTimings(uint16_t debounceDelay, uint16_t multiclickDuration, uint16_t longclickDuration);
+        bool idle();
+    protected:
+        friend class ButtonGroup;
+        void resync(unsigned long time, bool level);
+        void edge(unsigned long time, bool level);
+        void advance(unsigned long time);
+        // level of the last edge
+        bool _rawState;
     private:
-        int _pin;
+        bool moreClicksMatter();
+        void dispatch(void (*const funcs[MAX_CLICKS])());
+        uint16_t _debounceDelay;
+        uint16_t _multiclickDuration;
+        uint16_t _longclickDuration;
+        // debounced level
         bool _curState;
-        bool _changed;
-        unsigned long _lastDebounceTime;
+        // when the last edge happened
+        unsigned long _rawTime;
         unsigned long _lastClickTime;
-        int _numClicks;
-        void (*_1ShortPressFunc)();
-        void (*_2ShortPressFunc)();
-        void (*_3ShortPressFunc)();
-        void (*_1LongPressFunc)();
-        void (*_2LongPressFunc)();
-        void (*_3LongPressFunc)();
+        uint8_t _numClicks;
+        // handlers by click count - 1
+        void (*_shortPressFuncs[MAX_CLICKS])();
+        void (*_longPressFuncs[MAX_CLICKS])();
+};
+
+/**
+ * Push button on an interrupt pin.
+ * The change interrupt queues timestamped edges and loop() replays them in
+ * order, so debouncing and click counting run on the time the edges happened
+ * rather than the time loop() got to them. Clicks are not lost while the loop
+ * is blocked, e.g. by FastLED.show() or a flash write.
+ */
+class InterruptButton : public ButtonGesture {
+    public:
+        InterruptButton(int pin);
+        // void setChangeInterruptFunc(void (*changeInterruptFunc)());
+        void begin(void (*changeInterruptFunc)());
+        void changeInterruptFunc();
+        void loop();
+    private:
+        int _pin;
+        EdgeQueue _edges;
+};
+
+#ifdef __AVR__
+    typedef volatile uint8_t PortRegister;
+    typedef uint8_t PortMask;
+#else
+    typedef volatile uint32_t PortRegister;
+    typedef uint32_t PortMask;
+#endif
+
+// buttons a ButtonGroup can hold, one bit each in a queued edge
+#define MAX_GROUP_BUTTONS 8
+
+/**
+ * A button of a ButtonGroup.
+ * RAM per button: 33 bytes on AVR, 60 bytes on ESP32.
+ */
+class GroupButton : public ButtonGesture {
+    public:
+        GroupButton(int pin);
+    private:
+        friend class ButtonGroup;
+        uint8_t _pin;
+        PortMask _mask;
+        PortRegister* _port;
+};
+
+/**
+ * Up to MAX_GROUP_BUTTONS buttons serviced by one interrupt handler.
+ * The handler reads the input register of each port the buttons are on once
+ * and queues the levels of all buttons as one timestamped edge, so its cost
+ * is one register read per port plus a mask test per button. loop() replays
+ * the edges into each button's gesture state machine, which only does work
+ * for buttons whose level changed. Keep buttons on the same port next to each
+ * other in the array so the port is read once.
+ *
+ * On ESP32 begin() attaches the handler to every button pin. On AVR it enables
+ * the pin change interrupts of the button pins, and the sketch forwards the
+ * port's vector to the group:
+ *    ISR(PCINT2_vect) { buttonGroup.changeInterruptFunc(); }
+ */
+class ButtonGroup {
+    public:
+        ButtonGroup(GroupButton* buttons, uint8_t numButtons);
+        void begin(void (*changeInterruptFunc)());
+        void changeInterruptFunc();
+        void loop();
+    private:
+        uint8_t readLevels();
+        GroupButton* _buttons;
+        uint8_t _numButtons;
+        EdgeQueue _edges;
 };
 
 #endif
@@ -0,0 +1,158 @@
+#include "configstore.h"
+#ifndef ESP32
+    #include <EEPROM.h>
+#endif
+
+/**
+ * a record larger than CONFIG_STORE_MAX_RECORD doesn't fit the record buffers,
+ * so the store gets no slots: load() finds no record and save() writes nothing
+ */
+ConfigStore::ConfigStore(uint16_t dataSize, uint8_t numSlots, int baseAddr) {
+    _dataSize = dataSize;
+    _recordSize = dataSize + 4;
+    _numSlots = _recordSize <= CONFIG_STORE_MAX_RECORD ? numSlots : 0;
+    _baseAddr = baseAddr;
+    _slot = _numSlots;
+    _sequence = 0;
+}
+
+/**
+ * name - NVS namespace of the slots on ESP32, unused on AVR
+ */
+void ConfigStore::begin(const char* name) {
+    #ifdef ESP32
+        _prefs.begin(name);
+    #else
+        (void)name;
+    #endif
+}
+
+/**
+ * load the newest valid record into data.
+ * returns false if there is none, e.g. on first boot.
+ */
+bool ConfigStore::load(void* data) {
+    uint8_t record[CONFIG_STORE_MAX_RECORD];
+    _slot = _numSlots;
+    if (!_numSlots) return false;
+    uint16_t firstSequence = readSequence(0);
+    uint16_t sequence = firstSequence;
+    for (uint8_t i=0;i<_numSlots;i++) {
+        // a chain of consecutive sequence numbers ends at slot i
+        uint16_t nextSequence = i + 1 < _numSlots ? readSequence(i + 1) : firstSequence;
+        bool chainEnd = nextSequence != (uint16_t)(sequence + 1);
+        if (chainEnd) {
+            // walk back to the newest record of the chain that isn't torn
+            uint8_t slot = i;
+            uint16_t slotSequence = sequence;
+            for (uint8_t n=0;n<_numSlots;n++) {
+                if (readRecord(slot, record)) {
+                    if (_slot == _numSlots || (int16_t)(slotSequence - _sequence) > 0) {
+                        _slot = slot;
+                        _sequence = slotSequence;
+                        memcpy(data, record + 2, _dataSize);
+                    }
+                    break;
+                }
+                uint8_t prev = slot ? slot - 1 : _numSlots - 1;
+                uint16_t prevSequence = readSequence(prev);
+                if ((uint16_t)(prevSequence + 1) != slotSequence) break;
+                slot = prev;
+                slotSequence = prevSequence;
+            }
+        }
+        sequence = nextSequence;
+    }
+    return _slot != _numSlots;
+}
+
+/**
+ * append data as the newest record
+ */
+void ConfigStore::save(const void* data) {
+    uint8_t record[CONFIG_STORE_MAX_RECORD];
+    if (!_numSlots) return;
+    if (_slot == _numSlots) {
+        _slot = 0;
+        _sequence = 0;
+    } else {
+        _slot = _slot + 1 < _numSlots ? _slot + 1 : 0;
+        _sequence++;
+    }
+    record[0] = _sequence;
+    record[1] = _sequence >> 8;
+    memcpy(record + 2, data, _dataSize);
+    uint16_t crc = crc16(record, _dataSize + 2);
+    record[_dataSize + 2] = crc;
+    record[_dataSize + 3] = crc >> 8;
+    writeRecord(_slot, record);
+}
+
+/**
+ * sequence number of the newest record
+ */
+uint16_t ConfigStore::getSequence() {
+    return _sequence;
+}
+
+/**
+ * slot of the newest record
+ */
+uint8_t ConfigStore::getSlot() {
+    return _slot;
+}
+
+uint16_t ConfigStore::readSequence(uint8_t slot) {
+    #ifdef ESP32
+        uint8_t record[CONFIG_STORE_MAX_RECORD];
+        char key[4] = {'r', (char)('0' + slot / 10), (char)('0' + slot % 10), 0};
+        if (_prefs.getBytes(key, record, _recordSize) != _recordSize) return 0xFFFF;
+        return record[0] | (record[1] << 8);
+    #else
+        int addr = _baseAddr + slot * _recordSize;
+        return EEPROM.read(addr) | (EEPROM.read(addr + 1) << 8);
+    #endif
+}
+
+/**
+ * read a record, returns false if its CRC doesn't match
+ */
+bool ConfigStore::readRecord(uint8_t slot, uint8_t* record) {
+    #ifdef ESP32
+        char key[4] = {'r', (char)('0' + slot / 10), (char)('0' + slot % 10), 0};
+        if (_prefs.getBytes(key, record, _recordSize) != _recordSize) return false;
+    #else
+        int addr = _baseAddr + slot * _recordSize;
+        for (uint16_t i=0;i<_recordSize;i++) record[i] = EEPROM.read(addr + i);
+    #endif
+    uint16_t crc = record[_dataSize + 2] | (record[_dataSize + 3] << 8);
+    return crc == crc16(record, _dataSize + 2);
+}
+
+/**
+ * EEPROM.update() skips bytes that already hold the value, so a slot that
+ * last held the same config only wears the sequence number and CRC bytes
+ */
+void ConfigStore::writeRecord(uint8_t slot, const uint8_t* record) {
+    #ifdef ESP32
+        char key[4] = {'r', (char)('0' + slot / 10), (char)('0' + slot % 10), 0};
+        _prefs.putBytes(key, record, _recordSize);
+    #else
+        int addr = _baseAddr + slot * _recordSize;
+        for (uint16_t i=0;i<_recordSize;i++) EEPROM.update(addr + i, record[i]);
+    #endif
+}
+
+/**
+ * CRC-16/CCITT-FALSE
+ */
+uint16_t ConfigStore::crc16(const uint8_t* data, uint16_t len) {
+    uint16_t crc = 0xFFFF;
+    for (uint16_t i=0;i<len;i++) {
+        crc ^= (uint16_t) data[i] << 8;
+        for (uint8_t bit=0;bit<8;bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,48 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+#include <Arduino.h>
+#ifdef ESP32
+    #include <Preferences.h>
+#endif
+
+// largest record, data plus sequence number and CRC; a larger one is rejected
+#define CONFIG_STORE_MAX_RECORD 64
+
+/**
+ * Append-only log of fixed-size config records in a ring of slots, in EEPROM
+ * from baseAddr on AVR and as one NVS key per slot on ESP32.
+ *
+ * Each save goes to the slot after the newest record, so writes are spread
+ * evenly over all slots. A record is its data, a 16 bit sequence number and a
+ * CRC-16 over both. A record torn by a power cut fails its CRC, and load()
+ * falls back to the newest record before it.
+ *
+ * load() follows the chain of consecutive sequence numbers to its end, so it
+ * reads the sequence numbers of the slots and usually CRC-checks one record.
+ */
+class ConfigStore {
+    public:
+        ConfigStore(uint16_t dataSize, uint8_t numSlots, int baseAddr = 0);
+        void begin(const char* name);
+        bool load(void* data);
+        void save(const void* data);
+        uint16_t getSequence();
+        uint8_t getSlot();
+    private:
+        uint16_t readSequence(uint8_t slot);
+        bool readRecord(uint8_t slot, uint8_t* record);
+        void writeRecord(uint8_t slot, const uint8_t* record);
+        static uint16_t crc16(const uint8_t* data, uint16_t len);
+        uint16_t _dataSize;
+        uint16_t _recordSize;
+        uint8_t _numSlots;
+        int _baseAddr;
+        #ifdef ESP32
+            Preferences _prefs;
+        #endif
+        // newest record, _slot is _numSlots if there is none
+        uint8_t _slot;
+        uint16_t _sequence;
+};
+
+#endif
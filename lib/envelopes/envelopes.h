@@ -0,0 +1,91 @@
+#ifndef ENVELOPES_H
+#define ENVELOPES_H
+#include <Arduino.h>
+
+/**
+ * Brightness envelope tables generated at compile time into PROGMEM.
+ * RAMP_TABLE holds the fade curve over its rising half, 0-128, which covers
+ * both the rising (0-64) and the falling (64-128) quarter of every fade. It
+ * is the curve of sin8(), 128 to 255 and back, at 16 bits and already gamma
+ * corrected, so a fade step is two table reads and an interpolation, with no
+ * sin8(), division or gamma math left on the hot path.
+ */
+
+namespace envelopes {
+
+constexpr double HALF_TURN = 3.14159265358979;
+
+/**
+ * sine over 0 to HALF_TURN / 2, as a Taylor series
+ */
+constexpr double sinQuarter(double x) {
+    return x * (1 - x * x / 6 * (1 - x * x / 20 * (1 - x * x / 42 * (1 - x * x / 72
+        * (1 - x * x / 110 * (1 - x * x / 156))))));
+}
+
+constexpr double sinHalf(double x) {
+    return x <= HALF_TURN / 2 ? sinQuarter(x) : sinQuarter(HALF_TURN - x);
+}
+
+/**
+ * CHSV dims its value by squaring it, so the fade levels are squared too
+ */
+constexpr double gammaCorrect(double level) {
+    return level * level;
+}
+
+/**
+ * sin8(theta) as a fraction of full brightness, gamma corrected, to 16 bits
+ */
+constexpr uint16_t ramp(unsigned int theta) {
+    return (uint16_t)(65535 * gammaCorrect((128 + 127 * sinHalf(HALF_TURN * theta / 128)) / 255) + 0.5);
+}
+
+/**
+ * compile-time index sequence, AVR has no <utility>
+ */
+template <unsigned int... I> struct Steps {};
+template <unsigned int N, unsigned int... I> struct MakeSteps : MakeSteps<N - 1, N - 1, I...> {};
+template <unsigned int... I> struct MakeSteps<0, I...> {
+    typedef Steps<I...> type;
+};
+
+template <uint16_t (*Shape)(unsigned int), typename S> struct Table;
+template <uint16_t (*Shape)(unsigned int), unsigned int... I> struct Table<Shape, Steps<I...> > {
+    static const uint16_t values[sizeof...(I)];
+};
+template <uint16_t (*Shape)(unsigned int), unsigned int... I>
+const uint16_t Table<Shape, Steps<I...> >::values[sizeof...(I)] PROGMEM = {Shape(I)...};
+
+/**
+ * an N entry PROGMEM table of Shape(0) ... Shape(N-1)
+ */
+template <uint16_t (*Shape)(unsigned int), unsigned int N> struct Envelope {
+    typedef Table<Shape, typename MakeSteps<N>::type> table;
+    static const unsigned int length = N;
+};
+
+}  // namespace envelopes
+
+typedef envelopes::Envelope<envelopes::ramp, 129> RAMP_TABLE;
+
+/**
+ * value of an envelope table at a step. steps past the end of the table
+ * read as off.
+ */
+template <typename E> inline uint16_t envelopeAt(unsigned int step) {
+    return step < E::length ? pgm_read_word(&E::table::values[step]) : 0;
+}
+
+/**
+ * value of an envelope table between a step and the next, frac in 1/256 steps
+ */
+template <typename E> inline uint16_t envelopeBetween(unsigned int step, uint8_t frac) {
+    const uint16_t from = envelopeAt<E>(step);
+    if (!frac) return from;
+    const uint16_t to = envelopeAt<E>(step + 1);
+    return to >= from ? from + (uint16_t)(((uint32_t)(to - from) * frac) >> 8)
+                      : from - (uint16_t)(((uint32_t)(from - to) * frac) >> 8);
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include "eventlog.h"
+
+EventLog::EventLog() {
+    _head = 0;
+    _tail = 0;
+    _dropped = 0;
+    _reported = 0;
+}
+
+bool EventLog::write(const __FlashStringHelper* format) {
+    return append(format, (const uint32_t*) NULL, 0);
+}
+
+/**
+ * values - a list of bytes, e.g. palette indices
+ */
+bool EventLog::write(const __FlashStringHelper* format, const uint8_t* values, uint8_t numValues) {
+    return append(format, values, numValues);
+}
+
+/**
+ * queue a record: the format's address, the number of values and the values,
+ * 7 bits to a byte with the top bit set on all but the last byte
+ */
+template <typename T> bool EventLog::append(const __FlashStringHelper* format, const T* values, uint8_t numValues) {
+    if (numValues > EVENT_LOG_MAX_VALUES) numValues = EVENT_LOG_MAX_VALUES;
+    uint16_t size = sizeof(format) + 1;
+    for (uint8_t i=0;i<numValues;i++) size += valueSize(values[i]);
+    if ((uint16_t)(_head - _tail) + size > EVENT_LOG_SIZE) {
+        _dropped++;
+        return false;
+    }
+    const uint8_t* address = (const uint8_t*) &format;
+    for (uint8_t i=0;i<sizeof(format);i++) put(address[i]);
+    put(numValues);
+    for (uint8_t i=0;i<numValues;i++) {
+        uint32_t value = values[i];
+        while (value > 0x7F) {
+            put((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        put(value);
+    }
+    return true;
+}
+
+template bool EventLog::append<uint8_t>(const __FlashStringHelper*, const uint8_t*, uint8_t);
+template bool EventLog::append<uint32_t>(const __FlashStringHelper*, const uint32_t*, uint8_t);
+
+/**
+ * format queued records into lines and pass them to writeFunc while they fit
+ * into room bytes. a record is only taken off the log once its whole line is
+ * written. returns the bytes written.
+ */
+uint16_t EventLog::drain(uint16_t room, void (*writeFunc)(const uint8_t* data, uint8_t len)) {
+    char line[EVENT_LOG_LINE_SIZE];
+    uint32_t values[EVENT_LOG_MAX_VALUES];
+    uint16_t written = 0;
+    while (_tail != _head) {
+        uint16_t pos = _tail;
+        const __FlashStringHelper* fmt;
+        uint8_t* address = (uint8_t*) &fmt;
+        for (uint8_t i=0;i<sizeof(fmt);i++) address[i] = peek(pos);
+        uint8_t numValues = peek(pos);
+        for (uint8_t i=0;i<numValues;i++) {
+            uint32_t value = 0;
+            uint8_t b;
+            uint8_t shift = 0;
+            do {
+                b = peek(pos);
+                value |= (uint32_t)(b & 0x7F) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            values[i] = value;
+        }
+        uint8_t len = format(line, fmt, values, numValues);
+        if (len > room) return written;
+        writeFunc((const uint8_t*) line, len);
+        room -= len;
+        written += len;
+        _tail = pos;
+    }
+    if (_dropped != _reported) {
+        values[0] = (uint16_t)(_dropped - _reported);
+        uint8_t len = format(line, F("log dropped=%"), values, 1);
+        if (len > room) return written;
+        writeFunc((const uint8_t*) line, len);
+        written += len;
+        _reported = _dropped;
+    }
+    return written;
+}
+
+/**
+ * true once everything, the report of dropped records too, is written
+ */
+bool EventLog::empty() {
+    return _tail == _head && _dropped == _reported;
+}
+
+/**
+ * records dropped since start-up because the log was full
+ */
+uint16_t EventLog::getDropped() {
+    return _dropped;
+}
+
+uint8_t EventLog::valueSize(uint32_t value) {
+    uint8_t size = 1;
+    while (value > 0x7F) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/**
+ * one line of text, cut to fit EVENT_LOG_LINE_SIZE, ending in \r\n like println()
+ */
+uint8_t EventLog::format(char* line, const __FlashStringHelper* format, const uint32_t* values, uint8_t numValues) {
+    const char* p = (const char*) format;
+    const uint8_t end = EVENT_LOG_LINE_SIZE - 2;
+    uint8_t len = 0;
+    uint8_t next = 0;
+    char c = pgm_read_byte(p++);
+    while (len < end && (c || next < numValues)) {
+        if (c && c != '%') {
+            line[len++] = c;
+            c = pgm_read_byte(p++);
+            continue;
+        }
+        if (!c && next) line[len++] = ',';
+        if (c) c = pgm_read_byte(p++);
+        if (next == numValues) continue;
+        char digits[10];
+        uint8_t numDigits = 0;
+        uint32_t value = values[next++];
+        do {
+            digits[numDigits++] = '0' + value % 10;
+            value /= 10;
+        } while (value);
+        while (numDigits && len < end) line[len++] = digits[--numDigits];
+    }
+    line[len++] = '\r';
+    line[len++] = '\n';
+    return len;
+}
+
+void EventLog::put(uint8_t b) {
+    _buffer[_head++ & (EVENT_LOG_SIZE - 1)] = b;
+}
+
+uint8_t EventLog::peek(uint16_t& pos) {
+    return _buffer[pos++ & (EVENT_LOG_SIZE - 1)];
+}
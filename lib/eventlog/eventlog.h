@@ -0,0 +1,93 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+#include <Arduino.h>
+
+// bytes of queued records, a power of two
+#ifndef EVENT_LOG_SIZE
+    #ifdef __AVR__
+        #define EVENT_LOG_SIZE 64
+    #else
+        #define EVENT_LOG_SIZE 256
+    #endif
+#endif
+// values one record can carry
+#define EVENT_LOG_MAX_VALUES 12
+// longest line written, with the line ending, below the AVR core's 64 byte transmit buffer
+#define EVENT_LOG_LINE_SIZE 48
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#ifndef LOG_LEVEL
+    #define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+ * Deferred log of short records.
+ * write() only queues the address of a format string in flash and the values
+ * it refers to, varint coded, so logging from a button handler costs a few
+ * bytes of RAM and no serial time. drain() formats the queued records into
+ * lines and hands over only as many whole lines as the caller has room for,
+ * e.g. the free space of the serial transmit buffer, so the loop never waits
+ * for the UART.
+ *
+ * Each % in the format is replaced by the next value, in decimal. Values past
+ * the last % are appended, separated by commas, so a list can be logged after
+ * its label. Values are unsigned.
+ *
+ * A record that doesn't fit is dropped and counted. Once the log has drained,
+ * drain() reports the drops since the last report in a line of its own.
+ * The log is for the loop, not for interrupt handlers.
+ *
+ * Use the LOG_* macros, which compile to nothing below LOG_LEVEL, e.g.
+ *    LOG_INFO(eventLog, F("battery mV=% step=%"), millivolts, step);
+ */
+class EventLog {
+    public:
+        EventLog();
+        bool write(const __FlashStringHelper* format);
+        bool write(const __FlashStringHelper* format, const uint8_t* values, uint8_t numValues);
+        template <typename... V> bool write(const __FlashStringHelper* format, uint32_t value, V... values) {
+            const uint32_t all[] = {value, (uint32_t) values...};
+            return append(format, all, 1 + sizeof...(V));
+        }
+        uint16_t drain(uint16_t room, void (*writeFunc)(const uint8_t* data, uint8_t len));
+        bool empty();
+        uint16_t getDropped();
+    private:
+        template <typename T> bool append(const __FlashStringHelper* format, const T* values, uint8_t numValues);
+        static uint8_t valueSize(uint32_t value);
+        static uint8_t format(char* line, const __FlashStringHelper* format, const uint32_t* values, uint8_t numValues);
+        void put(uint8_t b);
+        uint8_t peek(uint16_t& pos);
+        uint8_t _buffer[EVENT_LOG_SIZE];
+        uint16_t _head;
+        uint16_t _tail;
+        uint16_t _dropped;
+        uint16_t _reported;
+};
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+    #define LOG_ERROR(log, ...) (log).write(__VA_ARGS__)
+#else
+    #define LOG_ERROR(log, ...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+    #define LOG_WARN(log, ...) (log).write(__VA_ARGS__)
+#else
+    #define LOG_WARN(log, ...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+    #define LOG_INFO(log, ...) (log).write(__VA_ARGS__)
+#else
+    #define LOG_INFO(log, ...)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+    #define LOG_DEBUG(log, ...) (log).write(__VA_ARGS__)
+#else
+    #define LOG_DEBUG(log, ...)
+#endif
+
+#endif
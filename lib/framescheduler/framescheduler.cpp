@@ -0,0 +1,98 @@
+#include "framescheduler.h"
+
+FrameScheduler::FrameScheduler(unsigned int framesPerSecond) {
+    setTargetRate(framesPerSecond);
+    _nextFrameTime = 0;
+    _invalid = true;
+    resetStats();
+}
+
+void FrameScheduler::setTargetRate(unsigned int framesPerSecond) {
+    _framesPerSecond = framesPerSecond ? framesPerSecond : 1;
+    _framePeriodMicros = 1000000UL / _framesPerSecond;
+}
+
+unsigned int FrameScheduler::getTargetRate() {
+    return _framesPerSecond;
+}
+
+/**
+ * returns true once per frame period.
+ * if the loop fell behind by more than a whole period, the schedule is
+ * restarted from now instead of rendering a burst of catch-up frames.
+ */
+bool FrameScheduler::frameDue() {
+    unsigned long now = micros();
+    if ((long)(now - _nextFrameTime) < 0) return false;
+    _nextFrameTime += _framePeriodMicros;
+    if ((long)(now - _nextFrameTime) >= 0) _nextFrameTime = now + _framePeriodMicros;
+    return true;
+}
+
+/**
+ * count a rendered frame and push it with showFunc if any segment changed since
+ * the last push. showFunc gets a bitmask of the changed segments, bit i for
+ * segments[i]. returns true if the frame was pushed.
+ */
+bool FrameScheduler::present(LedSegment* segments, uint8_t numSegments, void (*showFunc)(uint8_t changedSegments)) {
+    _framesRendered++;
+    uint8_t changedSegments = 0;
+    for (uint8_t i=0;i<numSegments;i++) {
+        LedSegment& segment = segments[i];
+        if (!segment.rendered && !_invalid) continue;
+        segment.rendered = false;
+        uint32_t hash = hashFrame(segment.leds, segment.numLeds * sizeof(CRGB));
+        if (_invalid || hash != segment.pushedHash) {
+            segment.pushedHash = hash;
+            changedSegments |= 1 << i;
+        }
+    }
+    _invalid = false;
+    if (!changedSegments) {
+        _framesSkipped++;
+        return false;
+    }
+    showFunc(changedSegments);
+    _framesPushed++;
+    return true;
+}
+
+/**
+ * force the next presented frame to be pushed, e.g. after the strip lost power
+ * or the global brightness changed outside of the frame buffer
+ */
+void FrameScheduler::invalidate() {
+    _invalid = true;
+}
+
+unsigned long FrameScheduler::getFramesRendered() {
+    return _framesRendered;
+}
+
+unsigned long FrameScheduler::getFramesPushed() {
+    return _framesPushed;
+}
+
+unsigned long FrameScheduler::getFramesSkipped() {
+    return _framesSkipped;
+}
+
+void FrameScheduler::resetStats() {
+    _framesRendered = 0;
+    _framesPushed = 0;
+    _framesSkipped = 0;
+}
+
+/**
+ * 32 bit FNV-1a over the segment bytes. hashing avoids keeping a shadow copy
+ * of the frame buffer, which matters on the 2 KB AVR boards.
+ */
+uint32_t FrameScheduler::hashFrame(const void* frame, size_t len) {
+    const uint8_t* bytes = (const uint8_t*) frame;
+    uint32_t hash = 2166136261UL;
+    for (size_t i=0;i<len;i++) {
+        hash ^= bytes[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
@@ -0,0 +1,36 @@
+#ifndef FRAME_SCHEDULER_H
+#define FRAME_SCHEDULER_H
+#include <Arduino.h>
+#include "ledsegment.h"
+
+/**
+ * Fixed-rate frame scheduler with dirty-frame tracking.
+ * frameDue() paces rendering to the target frame rate.
+ * present() pushes a rendered frame out only if one of its segments differs
+ * from what was last pushed, so unchanged frames don't pay for the wire protocol.
+ * Only segments that were re-rendered since the last frame are compared.
+ */
+class FrameScheduler {
+    public:
+        FrameScheduler(unsigned int framesPerSecond);
+        void setTargetRate(unsigned int framesPerSecond);
+        unsigned int getTargetRate();
+        bool frameDue();
+        bool present(LedSegment* segments, uint8_t numSegments, void (*showFunc)(uint8_t changedSegments));
+        void invalidate();
+        unsigned long getFramesRendered();
+        unsigned long getFramesPushed();
+        unsigned long getFramesSkipped();
+        void resetStats();
+    private:
+        static uint32_t hashFrame(const void* frame, size_t len);
+        unsigned int _framesPerSecond;
+        unsigned long _framePeriodMicros;
+        unsigned long _nextFrameTime;
+        bool _invalid;
+        unsigned long _framesRendered;
+        unsigned long _framesPushed;
+        unsigned long _framesSkipped;
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "framestream.h"
+
+FrameStream::FrameStream(CRGB* leds, uint16_t numLeds) {
+    _pixels = (uint8_t*) leds;
+    _pixelBytes = numLeds * 3;
+    _pos = 0;
+    _frameBytes = 0;
+    _sum1 = 0;
+    _sum2 = 0;
+    _receiving = false;
+    _rxTime = 0;
+    resetStats();
+}
+
+/**
+ * take a received header, trailer or surplus pixel byte.
+ * returns true when it completed a frame with a good checksum.
+ */
+bool FrameStream::feed(uint8_t c) {
+    if (!_receiving) {
+        if (c != 'A') return false;
+        _receiving = true;
+        _pos = 1;
+        _rxTime = millis();
+        return false;
+    }
+    _rxTime = millis();
+    if (_pos < STREAM_HEADER_SIZE) {
+        // not a frame after all unless the magic goes on
+        if ((_pos == 1 && c != 'd') || (_pos == 2 && c != 'a')) {
+            _receiving = false;
+            return false;
+        }
+        _header[_pos - 1] = c;
+        if (++_pos < STREAM_HEADER_SIZE) return false;
+        if ((_header[2] ^ _header[3] ^ 0x55) != c) {
+            _receiving = false;
+            _framesDropped++;
+            return false;
+        }
+        _frameBytes = (((uint32_t) _header[2] << 8 | _header[3]) + 1) * 3;
+        _sum1 = 0;
+        _sum2 = 0;
+        return false;
+    }
+    const uint32_t pixelPos = _pos++ - STREAM_HEADER_SIZE;
+    if (pixelPos < _frameBytes) {
+        addToChecksum(c);
+        return false;
+    }
+    if (pixelPos == _frameBytes) {
+        _header[0] = c;
+        return false;
+    }
+    _receiving = false;
+    if (_header[0] != _sum1 || c != _sum2) {
+        _framesDropped++;
+        return false;
+    }
+    _framesReceived++;
+    return true;
+}
+
+/**
+ * where the next pixel bytes go in the frame buffer and how many of them
+ * fit, or NULL if the next byte isn't for the frame buffer
+ */
+uint8_t* FrameStream::pixelSpace(uint16_t& len) {
+    if (!_receiving || _pos < STREAM_HEADER_SIZE) return NULL;
+    const uint32_t pixelPos = _pos - STREAM_HEADER_SIZE;
+    const uint32_t end = _frameBytes < _pixelBytes ? _frameBytes : _pixelBytes;
+    if (pixelPos >= end) return NULL;
+    len = end - pixelPos;
+    return _pixels + pixelPos;
+}
+
+/**
+ * len bytes were read to pixelSpace()
+ */
+void FrameStream::commitPixels(uint16_t len) {
+    const uint8_t* pixels = _pixels + (_pos - STREAM_HEADER_SIZE);
+    for (uint16_t i=0;i<len;i++) addToChecksum(pixels[i]);
+    _pos += len;
+    _rxTime = millis();
+}
+
+/**
+ * true while a frame is partly received
+ */
+bool FrameStream::receiving() {
+    return _receiving;
+}
+
+/**
+ * drop a frame that stopped coming in for STREAM_TIMEOUT ms, call it from the loop
+ */
+void FrameStream::checkTimeout() {
+    if (!_receiving || millis() - _rxTime < STREAM_TIMEOUT) return;
+    _receiving = false;
+    if (_pos >= STREAM_HEADER_SIZE) _framesDropped++;
+}
+
+/**
+ * count a received frame that was shown too late, e.g. with the next one already coming in
+ */
+void FrameStream::markLate() {
+    _framesLate++;
+}
+
+unsigned long FrameStream::getFramesReceived() {
+    return _framesReceived;
+}
+
+/**
+ * frames with a bad header or checksum, or that stalled
+ */
+unsigned long FrameStream::getFramesDropped() {
+    return _framesDropped;
+}
+
+unsigned long FrameStream::getFramesLate() {
+    return _framesLate;
+}
+
+void FrameStream::resetStats() {
+    _framesReceived = 0;
+    _framesDropped = 0;
+    _framesLate = 0;
+}
+
+void FrameStream::addToChecksum(uint8_t c) {
+    _sum1 += c;
+    _sum2 += _sum1;
+}
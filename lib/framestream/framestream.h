@@ -0,0 +1,60 @@
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+#include <Arduino.h>
+#include "FastLED.h"
+
+// a frame that stops coming in for this long is dropped, in ms
+#define STREAM_TIMEOUT 50
+// bytes of a frame besides its pixels
+#define STREAM_HEADER_SIZE 6
+#define STREAM_TRAILER_SIZE 2
+
+/**
+ * Receives pixel frames streamed from a host straight into the frame buffer.
+ *
+ * A frame is an Adalight header, the pixels and a checksum:
+ *    'A', 'd', 'a', (LEDs - 1) >> 8, (LEDs - 1) & 0xFF, the two bytes before XOR 0x55,
+ *    red, green, blue of every LED,
+ *    sum1, sum2
+ * where sum1 adds up the pixel bytes and sum2 adds up sum1 after every byte,
+ * both mod 256. LEDs past the frame buffer are received and dropped.
+ *
+ * Header and trailer bytes go through feed(). The pixels are read by the
+ * caller straight into the frame buffer, at pixelSpace(), and handed over
+ * with commitPixels(), which adds them to the checksum where they are.
+ * A frame whose checksum fails has already overwritten the frame buffer, so
+ * only show the frame buffer when feed() reports a complete frame.
+ */
+class FrameStream {
+    public:
+        FrameStream(CRGB* leds, uint16_t numLeds);
+        bool feed(uint8_t c);
+        uint8_t* pixelSpace(uint16_t& len);
+        void commitPixels(uint16_t len);
+        bool receiving();
+        void checkTimeout();
+        void markLate();
+        unsigned long getFramesReceived();
+        unsigned long getFramesDropped();
+        unsigned long getFramesLate();
+        void resetStats();
+    private:
+        void addToChecksum(uint8_t c);
+        uint8_t* _pixels;
+        uint16_t _pixelBytes;
+        // bytes of the frame being received so far, header included
+        uint32_t _pos;
+        // pixel bytes of the frame being received
+        uint32_t _frameBytes;
+        // header bytes after the 'A', then the first trailer byte
+        uint8_t _header[STREAM_HEADER_SIZE - 1];
+        uint8_t _sum1;
+        uint8_t _sum2;
+        bool _receiving;
+        unsigned long _rxTime;
+        unsigned long _framesReceived;
+        unsigned long _framesDropped;
+        unsigned long _framesLate;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef LED_SEGMENT_H
+#define LED_SEGMENT_H
+#include <Arduino.h>
+#include "FastLED.h"
+
+/**
+ * A run of LEDs inside the frame buffer, e.g. the front, side RGB or rear lights.
+ * leds - first pixel of the segment in the frame buffer
+ * numLeds - length of the segment
+ * controller - index of the FastLED controller that drives the segment's data pin.
+ *    segments chained on one data line share a controller.
+ * rendered - set when the segment was re-rendered since the last present()
+ * pushedHash - hash of the segment content last pushed to the strip
+ * channelSums - red, green and blue summed over the segment as rendered, kept
+ *    up to date by whatever renders the segment so its current can be
+ *    estimated without reading the pixels back
+ */
+struct LedSegment {
+    CRGB* leds;
+    uint16_t numLeds;
+    uint8_t controller;
+    bool rendered;
+    uint32_t pushedHash;
+    uint32_t channelSums[3];
+};
+
+/**
+ * set every pixel of a segment to one color and mark it re-rendered
+ */
+inline void fillSegment(LedSegment& segment, const CRGB& color) {
+    fill_solid(segment.leds, segment.numLeds, color);
+    for (uint8_t i=0;i<3;i++) segment.channelSums[i] = (uint32_t) color[i] * segment.numLeds;
+    segment.rendered = true;
+}
+
+/**
+ * sum up the channels of a segment whose pixels were written by something
+ * that doesn't keep the sums, e.g. a frame streamed from a host
+ */
+inline void sumSegment(LedSegment& segment) {
+    for (uint8_t i=0;i<3;i++) segment.channelSums[i] = 0;
+    for (uint16_t n=0;n<segment.numLeds;n++) {
+        for (uint8_t i=0;i<3;i++) segment.channelSums[i] += segment.leds[n][i];
+    }
+}
+
+#endif
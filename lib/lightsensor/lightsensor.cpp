@@ -0,0 +1,89 @@
+#include "lightsensor.h"
+
+LightSensor::LightSensor(AdcSampler& sampler, uint8_t pin) : _sampler(sampler) {
+    _pin = pin;
+    _channel = 0;
+    _numThresholds = 0;
+    _hysteresis = 0;
+    _holdMillis = 0;
+    _reading = 0;
+    _level = 0;
+    _pendingLevel = 0;
+    _pendingTime = 0;
+    _ready = false;
+    _updateTime = 0;
+}
+
+/**
+ * add the pin to the sampler, before the sampler's begin()
+ */
+void LightSensor::begin(uint16_t timeConstantMillis) {
+    _channel = _sampler.addChannel(_pin, timeConstantMillis);
+}
+
+/**
+ * thresholds - in PROGMEM
+ */
+void LightSensor::setThresholds(const uint16_t* thresholds, uint8_t numThresholds, uint16_t hysteresis, uint16_t holdMillis) {
+    _numThresholds = numThresholds < LIGHT_SENSOR_MAX_LEVELS - 1 ? numThresholds : LIGHT_SENSOR_MAX_LEVELS - 1;
+    memcpy_P(_thresholds, thresholds, _numThresholds * sizeof(uint16_t));
+    _hysteresis = hysteresis;
+    _holdMillis = holdMillis;
+}
+
+/**
+ * level of a reading, staying on the current level inside the hysteresis
+ */
+uint8_t LightSensor::levelOf(uint16_t reading) {
+    uint8_t level = _level;
+    while (level < _numThresholds && reading > _thresholds[level] + _hysteresis) level++;
+    while (level > 0 && reading + _hysteresis < _thresholds[level - 1]) level--;
+    return level;
+}
+
+/**
+ * look at the filtered reading every LIGHT_SENSOR_UPDATE_INTERVAL ms.
+ * the first reading sets the level straight away.
+ * returns true if the level changed.
+ */
+bool LightSensor::update() {
+    if (millis() - _updateTime < LIGHT_SENSOR_UPDATE_INTERVAL) return false;
+    _updateTime = millis();
+    if (!_sampler.ready(_channel)) return false;
+    _reading = _sampler.read(_channel);
+    uint8_t level = levelOf(_reading);
+    if (!_ready) {
+        _ready = true;
+        _level = level;
+        _pendingLevel = level;
+        return true;
+    }
+    if (level != _pendingLevel) {
+        _pendingLevel = level;
+        _pendingTime = millis();
+    }
+    if (_pendingLevel == _level || millis() - _pendingTime < _holdMillis) return false;
+    _level = _pendingLevel;
+    return true;
+}
+
+/**
+ * true once there is a level
+ */
+bool LightSensor::ready() {
+    return _ready;
+}
+
+/**
+ * ambient level, 0 is darkest
+ */
+uint8_t LightSensor::getLevel() {
+    return _level;
+}
+
+/**
+ * filtered reading, 0 to ADC_SAMPLER_MAX
+ */
+uint16_t LightSensor::getReading() {
+    return _reading;
+}
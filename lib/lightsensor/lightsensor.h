@@ -0,0 +1,46 @@
+#ifndef LIGHT_SENSOR_H
+#define LIGHT_SENSOR_H
+#include <Arduino.h>
+#include "adcsampler.h"
+
+// how often update() looks at the reading, in ms
+#define LIGHT_SENSOR_UPDATE_INTERVAL 100
+// ambient levels at most, one more than thresholds
+#define LIGHT_SENSOR_MAX_LEVELS 4
+
+/**
+ * Ambient light level from an LDR on an AdcSampler channel.
+ *
+ * The level is the number of thresholds the filtered reading is above, so
+ * the thresholds go from dark to bright. Moving to another level takes the
+ * reading to be hysteresis past the threshold, and the new level to hold
+ * for holdMillis, so a streetlight passed on the way doesn't change it.
+ */
+class LightSensor {
+    public:
+        LightSensor(AdcSampler& sampler, uint8_t pin);
+        void begin(uint16_t timeConstantMillis);
+        void setThresholds(const uint16_t* thresholds, uint8_t numThresholds, uint16_t hysteresis, uint16_t holdMillis);
+        bool update();
+        bool ready();
+        uint8_t getLevel();
+        uint16_t getReading();
+    private:
+        uint8_t levelOf(uint16_t reading);
+        AdcSampler& _sampler;
+        uint8_t _pin;
+        uint8_t _channel;
+        uint16_t _thresholds[LIGHT_SENSOR_MAX_LEVELS - 1];
+        uint8_t _numThresholds;
+        uint16_t _hysteresis;
+        uint16_t _holdMillis;
+        uint16_t _reading;
+        uint8_t _level;
+        // level the reading moved to, and since when
+        uint8_t _pendingLevel;
+        unsigned long _pendingTime;
+        bool _ready;
+        unsigned long _updateTime;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+/**
+ * Host stand-in for the parts of the Arduino core this project uses.
+ * Time is simulated: millis()/micros() only move when the harness
+ * advances them with nativeAdvanceMicros(), so runs are deterministic.
+ */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+
+#define PROGMEM
+#define IRAM_ATTR
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void * const *)(addr))
+#define memcpy_P memcpy
+#define digitalPinToInterrupt(p) (p)
+// pins 0-31 are port 0 and 32-63 port 1, like the ESP32 GPIO input registers
+#define digitalPinToPort(p) ((p) >> 5)
+#define digitalPinToBitMask(p) (1UL << ((p) & 31))
+#define portInputRegister(port) (&nativePortLevels[port])
+extern volatile uint32_t nativePortLevels[2];
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+int analogRead(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(), int mode);
+void detachInterrupt(uint8_t interruptNum);
+void noInterrupts();
+void interrupts();
+
+class HardwareSerial {
+    public:
+        void begin(unsigned long baud);
+        void end();
+        int available();
+        int read();
+        int peek();
+        int availableForWrite();
+        size_t readBytes(uint8_t* buffer, size_t length);
+        size_t write(uint8_t c);
+        size_t write(const uint8_t* buffer, size_t size);
+        void flush();
+        size_t print(const char* s);
+        size_t print(const __FlashStringHelper* s);
+        size_t print(char c);
+        size_t print(int n);
+        size_t print(unsigned int n);
+        size_t print(long n);
+        size_t print(unsigned long n);
+        size_t print(double n);
+        size_t println();
+        size_t println(const char* s);
+        size_t println(const __FlashStringHelper* s);
+        size_t println(char c);
+        size_t println(int n);
+        size_t println(unsigned int n);
+        size_t println(long n);
+        size_t println(unsigned long n);
+        size_t println(double n);
+        size_t printf(const char* format, ...);
+        operator bool() { return true; }
+};
+extern HardwareSerial Serial;
+
+/**
+ * harness controls
+ */
+void nativeSetMicros(unsigned long long us);
+void nativeAdvanceMicros(unsigned long long us);
+void nativeSetPin(uint8_t pin, int level);
+void nativeSetAnalog(uint8_t pin, int value);
+void nativeFeedSerial(const uint8_t* data, size_t len);
+void nativeSetSerialEcho(bool echo);
+// drain Serial output at baud through a transmit buffer of NATIVE_SERIAL_TX_BUFFER bytes,
+// writes then wait for room like the Arduino core's; 0 writes instantly
+#define NATIVE_SERIAL_TX_BUFFER 64
+void nativeSetSerialBaud(unsigned long baud);
+// called when the firmware goes to sleep until a pin reads low
+extern void (*nativeSleepHook)(uint8_t pin);
+// the ADC interrupt, called every NATIVE_ADC_MICROS of simulated time
+#define NATIVE_ADC_MICROS 1024
+extern void (*nativeAdcHook)();
+// gets everything written to Serial, e.g. to play the host end of a serial link
+extern void (*nativeSerialTxHook)(const uint8_t* data, size_t len);
+// called when the firmware asks what Serial has received, e.g. to deliver bytes due by now
+extern void (*nativeSerialRxHook)();
+
+#endif
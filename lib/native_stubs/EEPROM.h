@@ -0,0 +1,40 @@
+#ifndef NATIVE_EEPROM_H
+#define NATIVE_EEPROM_H
+/**
+ * Host stand-in for the AVR EEPROM library.
+ * Sized like the ATmega328P EEPROM and counts writes per cell so wear can be
+ * inspected from the harness.
+ */
+#include <Arduino.h>
+
+#define E2END 0x3FF
+
+class EEPROMClass {
+    public:
+        EEPROMClass();
+        uint8_t read(int idx);
+        void write(int idx, uint8_t val);
+        void update(int idx, uint8_t val);
+        uint16_t length() { return E2END + 1; }
+        template <typename T> T& get(int idx, T& t) {
+            uint8_t* ptr = (uint8_t*) &t;
+            for (size_t i=0;i<sizeof(T);i++) ptr[i] = read(idx + i);
+            return t;
+        }
+        template <typename T> const T& put(int idx, const T& t) {
+            const uint8_t* ptr = (const uint8_t*) &t;
+            for (size_t i=0;i<sizeof(T);i++) update(idx + i, ptr[i]);
+            return t;
+        }
+        /**
+         * harness controls: per-cell write counters and a write budget that
+         * simulates a power cut after the given number of byte writes
+         */
+        unsigned long writeCounts[E2END + 1];
+        long writesUntilPowerCut;
+    private:
+        uint8_t _cells[E2END + 1];
+};
+extern EEPROMClass EEPROM;
+
+#endif
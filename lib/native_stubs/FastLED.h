@@ -0,0 +1,171 @@
+#ifndef NATIVE_FASTLED_H
+#define NATIVE_FASTLED_H
+/**
+ * Host stand-in for the FastLED types and lib8tion helpers the project uses.
+ * The 8-bit math matches FastLED's C implementations so frames rendered on
+ * the host are the frames the strips would get.
+ */
+#include <Arduino.h>
+
+typedef uint8_t fract8;
+typedef uint16_t fract16;
+
+inline uint8_t scale8(uint8_t i, fract8 scale) {
+    return (((uint16_t)i) * (1 + (uint16_t)scale)) >> 8;
+}
+
+inline uint8_t scale8_video(uint8_t i, fract8 scale) {
+    return (((int)i * (int)scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+inline uint16_t scale16(uint16_t i, fract16 scale) {
+    return ((uint32_t)i * (1 + (uint32_t)scale)) >> 16;
+}
+
+inline uint16_t scale16by8(uint16_t i, fract8 scale) {
+    return (i * (1 + ((uint16_t)scale))) >> 8;
+}
+
+inline uint8_t qadd8(uint8_t i, uint8_t j) {
+    unsigned int t = i + j;
+    return t > 255 ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j) {
+    int t = i - j;
+    return t < 0 ? 0 : t;
+}
+
+inline uint8_t sin8(uint8_t theta) {
+    static const uint8_t b_m16_interleave[] = {0, 49, 49, 41, 90, 27, 117, 10};
+    uint8_t offset = theta;
+    if (theta & 0x40) offset = (uint8_t)255 - offset;
+    offset &= 0x3F;
+    uint8_t secoffset = offset & 0x0F;
+    if (theta & 0x40) ++secoffset;
+    uint8_t section = offset >> 4;
+    uint8_t s2 = section * 2;
+    uint8_t b = b_m16_interleave[s2];
+    uint8_t m16 = b_m16_interleave[s2 + 1];
+    uint8_t mx = (m16 * secoffset) >> 4;
+    int8_t y = mx + b;
+    if (theta & 0x80) y = -y;
+    y += 128;
+    return y;
+}
+
+struct CHSV {
+    union {
+        struct {
+            uint8_t hue;
+            uint8_t sat;
+            uint8_t val;
+        };
+        uint8_t raw[3];
+    };
+    CHSV() : hue(0), sat(0), val(0) {}
+    CHSV(uint8_t ih, uint8_t is, uint8_t iv) : hue(ih), sat(is), val(iv) {}
+};
+
+struct CRGB;
+void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb);
+
+struct CRGB {
+    union {
+        struct {
+            uint8_t r;
+            uint8_t g;
+            uint8_t b;
+        };
+        uint8_t raw[3];
+    };
+    CRGB() : r(0), g(0), b(0) {}
+    CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+    CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+    CRGB(const CHSV& rhs) { hsv2rgb_rainbow(rhs, *this); }
+    CRGB& operator=(const CHSV& rhs) {
+        hsv2rgb_rainbow(rhs, *this);
+        return *this;
+    }
+    CRGB& nscale8(uint8_t scaledown) {
+        r = scale8(r, scaledown);
+        g = scale8(g, scaledown);
+        b = scale8(b, scaledown);
+        return *this;
+    }
+    CRGB& nscale8_video(uint8_t scaledown) {
+        r = scale8_video(r, scaledown);
+        g = scale8_video(g, scaledown);
+        b = scale8_video(b, scaledown);
+        return *this;
+    }
+    uint8_t& operator[](uint8_t x) { return raw[x]; }
+    const uint8_t& operator[](uint8_t x) const { return raw[x]; }
+    enum HTMLColorCode {
+        Black = 0x000000,
+        Red = 0xFF0000,
+        White = 0xFFFFFF,
+    };
+};
+
+inline bool operator==(const CRGB& lhs, const CRGB& rhs) {
+    return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+}
+
+inline bool operator!=(const CRGB& lhs, const CRGB& rhs) {
+    return !(lhs == rhs);
+}
+
+void fill_solid(CRGB* targetArray, int numToFill, const CRGB& color);
+
+enum EOrder { RGB = 0012, RBG = 0021, GRB = 0102, GBR = 0120, BRG = 0201, BGR = 0210 };
+enum LEDColorCorrection { TypicalLEDStrip = 0xFFB0F0, UncorrectedColor = 0xFFFFFF };
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER = GRB> class WS2812B {};
+template <uint8_t DATA_PIN, EOrder RGB_ORDER = GRB> class WS2812 {};
+
+class CLEDController {
+    public:
+        CLEDController();
+        CLEDController& setCorrection(LEDColorCorrection correction) { (void)correction; return *this; }
+        CLEDController& setLeds(CRGB* data, int nLeds) { _leds = data; _numLeds = nLeds; return *this; }
+        void showLeds(uint8_t brightness);
+        CRGB* leds() { return _leds; }
+        int size() { return _numLeds; }
+        int pin;
+        unsigned long showCount;
+    private:
+        CRGB* _leds;
+        int _numLeds;
+};
+
+class CFastLED {
+    public:
+        template <template <uint8_t DATA_PIN, EOrder RGB_ORDER> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+        CLEDController& addLeds(CRGB* data, int nLedsOrOffset, int nLedsIfOffset = 0) {
+            int offset = (nLedsIfOffset > 0) ? nLedsOrOffset : 0;
+            int nLeds = (nLedsIfOffset > 0) ? nLedsIfOffset : nLedsOrOffset;
+            return addController(DATA_PIN, data + offset, nLeds);
+        }
+        void setBrightness(uint8_t scale) { _brightness = scale; }
+        uint8_t getBrightness() { return _brightness; }
+        void show() { show(_brightness); }
+        void show(uint8_t scale);
+        void clear(bool writeData = false);
+        int count() { return _numControllers; }
+        CLEDController& operator[](int x) { return _controllers[x]; }
+        unsigned long showCount;
+        /**
+         * simulated wire time per LED, 30 us for WS2812B; 0 disables it
+         */
+        unsigned int showMicrosPerLed;
+    private:
+        CLEDController& addController(int pin, CRGB* data, int nLeds);
+        enum { MAX_CONTROLLERS = 8 };
+        CLEDController _controllers[MAX_CONTROLLERS];
+        int _numControllers;
+        uint8_t _brightness = 255;
+};
+extern CFastLED FastLED;
+
+#endif
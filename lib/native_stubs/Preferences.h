@@ -0,0 +1,36 @@
+#ifndef NATIVE_PREFERENCES_H
+#define NATIVE_PREFERENCES_H
+/**
+ * Host stand-in for the ESP32 Preferences (NVS) library, kept in RAM.
+ */
+#include <Arduino.h>
+
+class Preferences {
+    public:
+        bool begin(const char* name, bool readOnly = false, const char* partition_label = NULL);
+        void end();
+        bool clear();
+        bool remove(const char* key);
+        bool isKey(const char* key);
+        size_t putBytes(const char* key, const void* value, size_t len);
+        size_t getBytesLength(const char* key);
+        size_t getBytes(const char* key, void* buf, size_t maxLen);
+        size_t putUChar(const char* key, uint8_t value);
+        uint8_t getUChar(const char* key, uint8_t defaultValue = 0);
+        /**
+         * number of putBytes/putUChar calls, for wear accounting
+         */
+        unsigned long writeCount;
+    private:
+        enum { MAX_KEYS = 32, KEY_LEN = 16, MAX_VALUE = 64 };
+        struct Entry {
+            char key[KEY_LEN];
+            uint8_t value[MAX_VALUE];
+            size_t len;
+            bool used;
+        };
+        Entry* find(const char* key);
+        Entry _entries[MAX_KEYS];
+};
+
+#endif
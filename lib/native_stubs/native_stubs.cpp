@@ -0,0 +1,474 @@
+#include <Arduino.h>
+#include <FastLED.h>
+#include <Preferences.h>
+#include <EEPROM.h>
+
+HardwareSerial Serial;
+CFastLED FastLED;
+EEPROMClass EEPROM;
+
+/**
+ * simulated clock, pins and serial input
+ */
+static unsigned long long nativeMicros;
+static const int NATIVE_PINS = 64;
+static int pinLevels[NATIVE_PINS];
+volatile uint32_t nativePortLevels[2];
+static int analogValues[NATIVE_PINS];
+static void (*pinIsrs[NATIVE_PINS])();
+static int pinIsrModes[NATIVE_PINS];
+static uint8_t serialRx[4096];
+static size_t serialRxHead;
+static size_t serialRxTail;
+static bool serialEcho = true;
+static unsigned long long serialTxByteNanos;
+// when the transmit buffer will have gone out, in ns
+static unsigned long long serialTxIdleNanos;
+void (*nativeSleepHook)(uint8_t pin);
+void (*nativeAdcHook)();
+void (*nativeSerialTxHook)(const uint8_t* data, size_t len);
+void (*nativeSerialRxHook)();
+static unsigned long nativeAdcMicros;
+
+static void setPinLevel(uint8_t pin, int level) {
+    pinLevels[pin] = level;
+    if (level) nativePortLevels[pin >> 5] |= 1UL << (pin & 31);
+    else nativePortLevels[pin >> 5] &= ~(1UL << (pin & 31));
+}
+
+unsigned long millis() {
+    return (unsigned long)(nativeMicros / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)nativeMicros;
+}
+
+void delay(unsigned long ms) {
+    nativeAdvanceMicros((unsigned long long)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+    nativeAdvanceMicros(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin < NATIVE_PINS && mode == INPUT_PULLUP) setPinLevel(pin, HIGH);
+}
+
+int digitalRead(uint8_t pin) {
+    return pin < NATIVE_PINS ? pinLevels[pin] : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin < NATIVE_PINS) setPinLevel(pin, val);
+}
+
+int analogRead(uint8_t pin) {
+    return pin < NATIVE_PINS ? analogValues[pin] : 0;
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(), int mode) {
+    if (interruptNum >= NATIVE_PINS) return;
+    pinIsrs[interruptNum] = userFunc;
+    pinIsrModes[interruptNum] = mode;
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+    if (interruptNum < NATIVE_PINS) pinIsrs[interruptNum] = NULL;
+}
+
+void noInterrupts() {}
+
+void interrupts() {}
+
+void nativeSetMicros(unsigned long long us) {
+    nativeMicros = us;
+}
+
+void nativeAdvanceMicros(unsigned long long us) {
+    nativeMicros += us;
+    nativeAdcMicros += us;
+    while (nativeAdcMicros >= NATIVE_ADC_MICROS) {
+        nativeAdcMicros -= NATIVE_ADC_MICROS;
+        if (nativeAdcHook) nativeAdcHook();
+    }
+}
+
+void nativeSetPin(uint8_t pin, int level) {
+    if (pin >= NATIVE_PINS) return;
+    int previous = pinLevels[pin];
+    setPinLevel(pin, level);
+    if (previous == level || pinIsrs[pin] == NULL) return;
+    int mode = pinIsrModes[pin];
+    if (mode == CHANGE || (mode == RISING && level) || (mode == FALLING && !level)) {
+        pinIsrs[pin]();
+    }
+}
+
+void nativeSetAnalog(uint8_t pin, int value) {
+    if (pin < NATIVE_PINS) analogValues[pin] = value;
+}
+
+void nativeFeedSerial(const uint8_t* data, size_t len) {
+    for (size_t i=0;i<len;i++) {
+        serialRx[serialRxHead] = data[i];
+        serialRxHead = (serialRxHead + 1) % sizeof(serialRx);
+    }
+}
+
+void nativeSetSerialEcho(bool echo) {
+    serialEcho = echo;
+}
+
+void nativeSetSerialBaud(unsigned long baud) {
+    serialTxByteNanos = baud ? 10000000000ULL / baud : 0;
+    serialTxIdleNanos = nativeMicros * 1000;
+}
+
+static int serialTxPending() {
+    const unsigned long long now = nativeMicros * 1000;
+    if (!serialTxByteNanos || serialTxIdleNanos <= now) return 0;
+    return (int)((serialTxIdleNanos - now + serialTxByteNanos - 1) / serialTxByteNanos);
+}
+
+/**
+ * queue a byte for the simulated UART, waiting while the buffer is full
+ */
+static void serialTxByte() {
+    if (!serialTxByteNanos) return;
+    if (serialTxPending() >= NATIVE_SERIAL_TX_BUFFER) {
+        const unsigned long long room = serialTxIdleNanos - (NATIVE_SERIAL_TX_BUFFER - 1) * serialTxByteNanos;
+        nativeAdvanceMicros((room - nativeMicros * 1000 + 999) / 1000);
+    }
+    const unsigned long long now = nativeMicros * 1000;
+    serialTxIdleNanos = (serialTxIdleNanos > now ? serialTxIdleNanos : now) + serialTxByteNanos;
+}
+
+/**
+ * Serial: output goes to stdout unless echo is disabled by the harness
+ */
+void HardwareSerial::begin(unsigned long baud) { (void)baud; }
+
+void HardwareSerial::end() {}
+
+int HardwareSerial::available() {
+    if (nativeSerialRxHook) {
+        // the hook may ask what is buffered itself
+        void (*hook)() = nativeSerialRxHook;
+        nativeSerialRxHook = NULL;
+        hook();
+        nativeSerialRxHook = hook;
+    }
+    return (int)((serialRxHead + sizeof(serialRx) - serialRxTail) % sizeof(serialRx));
+}
+
+int HardwareSerial::read() {
+    if (serialRxHead == serialRxTail) return -1;
+    uint8_t c = serialRx[serialRxTail];
+    serialRxTail = (serialRxTail + 1) % sizeof(serialRx);
+    return c;
+}
+
+int HardwareSerial::peek() {
+    if (serialRxHead == serialRxTail) return -1;
+    return serialRx[serialRxTail];
+}
+
+int HardwareSerial::availableForWrite() {
+    return NATIVE_SERIAL_TX_BUFFER - serialTxPending();
+}
+
+size_t HardwareSerial::readBytes(uint8_t* buffer, size_t length) {
+    size_t n = 0;
+    while (n < length && available()) buffer[n++] = (uint8_t) read();
+    return n;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    serialTxByte();
+    if (nativeSerialTxHook) nativeSerialTxHook(&c, 1);
+    if (serialEcho) fputc(c, stdout);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    for (size_t i=0;i<size;i++) serialTxByte();
+    if (nativeSerialTxHook) nativeSerialTxHook(buffer, size);
+    if (serialEcho) fwrite(buffer, 1, size, stdout);
+    return size;
+}
+
+void HardwareSerial::flush() {
+    const unsigned long long now = nativeMicros * 1000;
+    if (serialTxByteNanos && serialTxIdleNanos > now) nativeAdvanceMicros((serialTxIdleNanos - now + 999) / 1000);
+    if (serialEcho) fflush(stdout);
+}
+
+size_t HardwareSerial::print(const char* s) { return printf("%s", s); }
+size_t HardwareSerial::print(const __FlashStringHelper* s) { return printf("%s", (const char*) s); }
+size_t HardwareSerial::print(char c) { return printf("%c", c); }
+size_t HardwareSerial::print(int n) { return printf("%d", n); }
+size_t HardwareSerial::print(unsigned int n) { return printf("%u", n); }
+size_t HardwareSerial::print(long n) { return printf("%ld", n); }
+size_t HardwareSerial::print(unsigned long n) { return printf("%lu", n); }
+size_t HardwareSerial::print(double n) { return printf("%.2f", n); }
+size_t HardwareSerial::println() { return print("\r\n"); }
+size_t HardwareSerial::println(const char* s) { return print(s) + println(); }
+size_t HardwareSerial::println(const __FlashStringHelper* s) { return print(s) + println(); }
+size_t HardwareSerial::println(char c) { return print(c) + println(); }
+size_t HardwareSerial::println(int n) { return print(n) + println(); }
+size_t HardwareSerial::println(unsigned int n) { return print(n) + println(); }
+size_t HardwareSerial::println(long n) { return print(n) + println(); }
+size_t HardwareSerial::println(unsigned long n) { return print(n) + println(); }
+size_t HardwareSerial::println(double n) { return print(n) + println(); }
+
+size_t HardwareSerial::printf(const char* format, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if (len >= (int) sizeof(buf)) len = sizeof(buf) - 1;
+    return write((const uint8_t*) buf, len);
+}
+
+/**
+ * FastLED: hsv2rgb_rainbow and fill_solid follow FastLED's C implementations
+ */
+void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb) {
+    const uint8_t Y1 = 1;
+    const uint8_t G2 = 0;
+    const uint8_t Gscale = 0;
+    uint8_t hue = hsv.hue;
+    uint8_t sat = hsv.sat;
+    uint8_t val = hsv.val;
+    uint8_t offset = hue & 0x1F;
+    uint8_t offset8 = offset << 3;
+    uint8_t third = scale8(offset8, (256 / 3));
+    uint8_t r, g, b;
+    if (!(hue & 0x80)) {
+        if (!(hue & 0x40)) {
+            if (!(hue & 0x20)) {
+                r = 255 - third;
+                g = third;
+                b = 0;
+            } else {
+                if (Y1) {
+                    r = 171;
+                    g = 85 + third;
+                    b = 0;
+                } else {
+                    r = 170 + third;
+                    uint8_t twothirds = scale8(offset8, ((256 * 2) / 3));
+                    g = 85 + twothirds;
+                    b = 0;
+                }
+            }
+        } else {
+            if (!(hue & 0x20)) {
+                uint8_t twothirds = scale8(offset8, ((256 * 2) / 3));
+                r = 171 - twothirds;
+                g = 170 + third;
+                b = 0;
+            } else {
+                r = 0;
+                g = 255 - third;
+                b = third;
+            }
+        }
+    } else {
+        if (!(hue & 0x40)) {
+            if (!(hue & 0x20)) {
+                r = 0;
+                uint8_t twothirds = scale8(offset8, ((256 * 2) / 3));
+                g = 171 - twothirds;
+                b = 85 + twothirds;
+            } else {
+                r = third;
+                g = 0;
+                b = 255 - third;
+            }
+        } else {
+            if (!(hue & 0x20)) {
+                r = 85 + third;
+                g = 0;
+                b = 171 - third;
+            } else {
+                r = 170 + third;
+                g = 0;
+                b = 85 - third;
+            }
+        }
+    }
+    if (G2) g = g >> 1;
+    if (Gscale) g = scale8_video(g, Gscale);
+    if (sat != 255) {
+        if (sat == 0) {
+            r = 255;
+            b = 255;
+            g = 255;
+        } else {
+            uint8_t desat = 255 - sat;
+            desat = scale8_video(desat, desat);
+            uint8_t satscale = 255 - desat;
+            if (r) r = scale8(r, satscale) + 1;
+            if (g) g = scale8(g, satscale) + 1;
+            if (b) b = scale8(b, satscale) + 1;
+            uint8_t brightness_floor = desat;
+            r += brightness_floor;
+            g += brightness_floor;
+            b += brightness_floor;
+        }
+    }
+    if (val != 255) {
+        val = scale8_video(val, val);
+        if (val == 0) {
+            r = 0;
+            g = 0;
+            b = 0;
+        } else {
+            if (r) r = scale8(r, val) + 1;
+            if (g) g = scale8(g, val) + 1;
+            if (b) b = scale8(b, val) + 1;
+        }
+    }
+    rgb.r = r;
+    rgb.g = g;
+    rgb.b = b;
+}
+
+void fill_solid(CRGB* targetArray, int numToFill, const CRGB& color) {
+    for (int i=0;i<numToFill;i++) targetArray[i] = color;
+}
+
+CLEDController::CLEDController() : pin(-1), showCount(0), _leds(NULL), _numLeds(0) {}
+
+void CLEDController::showLeds(uint8_t brightness) {
+    (void)brightness;
+    showCount++;
+    if (FastLED.showMicrosPerLed) nativeAdvanceMicros((unsigned long long)FastLED.showMicrosPerLed * _numLeds);
+}
+
+void CFastLED::show(uint8_t scale) {
+    showCount++;
+    int longest = 0;
+    for (int i=0;i<_numControllers;i++) {
+        _controllers[i].showCount++;
+        if (_controllers[i].size() > longest) longest = _controllers[i].size();
+    }
+    (void)scale;
+    // controllers are timed as if driven in parallel, like the ESP32 RMT driver
+    if (showMicrosPerLed) nativeAdvanceMicros((unsigned long long)showMicrosPerLed * longest);
+}
+
+void CFastLED::clear(bool writeData) {
+    for (int i=0;i<_numControllers;i++) fill_solid(_controllers[i].leds(), _controllers[i].size(), CRGB(0, 0, 0));
+    if (writeData) show(0);
+}
+
+CLEDController& CFastLED::addController(int pin, CRGB* data, int nLeds) {
+    CLEDController& controller = _controllers[_numControllers < MAX_CONTROLLERS ? _numControllers++ : MAX_CONTROLLERS - 1];
+    controller.pin = pin;
+    controller.setLeds(data, nLeds);
+    return controller;
+}
+
+/**
+ * Preferences
+ */
+bool Preferences::begin(const char* name, bool readOnly, const char* partition_label) {
+    (void)name;
+    (void)readOnly;
+    (void)partition_label;
+    return true;
+}
+
+void Preferences::end() {}
+
+bool Preferences::clear() {
+    memset(_entries, 0, sizeof(_entries));
+    return true;
+}
+
+Preferences::Entry* Preferences::find(const char* key) {
+    for (int i=0;i<MAX_KEYS;i++) {
+        if (_entries[i].used && !strncmp(_entries[i].key, key, KEY_LEN)) return &_entries[i];
+    }
+    return NULL;
+}
+
+bool Preferences::remove(const char* key) {
+    Entry* entry = find(key);
+    if (entry == NULL) return false;
+    entry->used = false;
+    return true;
+}
+
+bool Preferences::isKey(const char* key) {
+    return find(key) != NULL;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+    if (len > MAX_VALUE) return 0;
+    Entry* entry = find(key);
+    for (int i=0;entry == NULL && i<MAX_KEYS;i++) {
+        if (!_entries[i].used) {
+            entry = &_entries[i];
+            entry->used = true;
+            strncpy(entry->key, key, KEY_LEN - 1);
+        }
+    }
+    if (entry == NULL) return 0;
+    memcpy(entry->value, value, len);
+    entry->len = len;
+    writeCount++;
+    return len;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    Entry* entry = find(key);
+    return entry == NULL ? 0 : entry->len;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+    Entry* entry = find(key);
+    if (entry == NULL || entry->len > maxLen) return 0;
+    memcpy(buf, entry->value, entry->len);
+    return entry->len;
+}
+
+size_t Preferences::putUChar(const char* key, uint8_t value) {
+    return putBytes(key, &value, 1);
+}
+
+uint8_t Preferences::getUChar(const char* key, uint8_t defaultValue) {
+    uint8_t value = defaultValue;
+    getBytes(key, &value, 1);
+    return value;
+}
+
+/**
+ * EEPROM, erased cells read 0xFF like the real part
+ */
+EEPROMClass::EEPROMClass() : writesUntilPowerCut(-1) {
+    memset(_cells, 0xFF, sizeof(_cells));
+    memset(writeCounts, 0, sizeof(writeCounts));
+}
+
+uint8_t EEPROMClass::read(int idx) {
+    return (idx >= 0 && idx <= E2END) ? _cells[idx] : 0xFF;
+}
+
+void EEPROMClass::write(int idx, uint8_t val) {
+    if (idx < 0 || idx > E2END) return;
+    if (writesUntilPowerCut == 0) return;
+    if (writesUntilPowerCut > 0) writesUntilPowerCut--;
+    _cells[idx] = val;
+    writeCounts[idx]++;
+}
+
+void EEPROMClass::update(int idx, uint8_t val) {
+    if (read(idx) != val) write(idx, val);
+}
@@ -0,0 +1,114 @@
+#include "powerlimit.h"
+
+PowerLimiter::PowerLimiter(uint16_t budgetMilliamps) {
+    _budget = budgetMilliamps;
+    _correction = CRGB(255, 255, 255);
+    _brightness = 255;
+    _lowPriority = 0;
+    _lowScale = 255;
+    _highScale = 255;
+    _milliamps = 0;
+    _demand = 0;
+}
+
+void PowerLimiter::setBudget(uint16_t budgetMilliamps) {
+    _budget = budgetMilliamps;
+}
+
+uint16_t PowerLimiter::getBudget() {
+    return _budget;
+}
+
+/**
+ * color correction and global brightness FastLED applies on output
+ */
+void PowerLimiter::setOutputScale(const CRGB& correction, uint8_t brightness) {
+    _correction = correction;
+    _brightness = brightness;
+}
+
+/**
+ * current of the lit channels of a segment at full scale, in 1/255 mA
+ */
+uint32_t PowerLimiter::segmentMilliamps(const LedSegment& segment) {
+    static const uint8_t CHANNEL_MILLIAMPS[3] = {LED_RED_MILLIAMPS, LED_GREEN_MILLIAMPS, LED_BLUE_MILLIAMPS};
+    uint32_t current = 0;
+    for (uint8_t c=0;c<3;c++) {
+        current += segment.channelSums[c] * _correction[c] / 255 * CHANNEL_MILLIAMPS[c];
+    }
+    return current * _brightness / 255;
+}
+
+/**
+ * largest scale that brings demand down to available.
+ * scale8() scales by (scale + 1) / 256.
+ */
+uint8_t PowerLimiter::fitScale(uint32_t available, uint32_t demand) {
+    const uint32_t scale = available * 256 / demand;
+    return scale ? scale - 1 : 0;
+}
+
+/**
+ * estimate the frame's current and work out the segment scales.
+ * lowPriority - bit mask of the segments to scale down first
+ * returns true if the scales changed.
+ */
+bool PowerLimiter::update(const LedSegment* segments, uint8_t numSegments, uint8_t lowPriority) {
+    uint32_t idle = 0;
+    uint32_t low = 0;
+    uint32_t high = 0;
+    for (uint8_t i=0;i<numSegments;i++) {
+        idle += segments[i].numLeds * LED_IDLE_MILLIAMPS;
+        if (lowPriority & (1 << i)) low += segmentMilliamps(segments[i]);
+        else high += segmentMilliamps(segments[i]);
+    }
+    // round up, so scaling to the budget never ends up above it
+    low = (low + 254) / 255;
+    high = (high + 254) / 255;
+    const uint32_t available = _budget > idle ? _budget - idle : 0;
+    uint8_t lowScale = 255;
+    uint8_t highScale = 255;
+    if (low + high > available) {
+        if (high <= available) {
+            lowScale = fitScale(available - high, low);
+        } else {
+            lowScale = 0;
+            highScale = fitScale(available, high);
+        }
+    }
+    _demand = idle + low + high;
+    _milliamps = idle + (low * (lowScale + 1) + high * (highScale + 1)) / 256;
+    bool changed = lowPriority != _lowPriority || lowScale != _lowScale || highScale != _highScale;
+    _lowPriority = lowPriority;
+    _lowScale = lowScale;
+    _highScale = highScale;
+    return changed;
+}
+
+/**
+ * scale a segment that was re-rendered at full scale down to its share of
+ * the budget. index is its index in the segments given to update().
+ */
+void PowerLimiter::apply(LedSegment& segment, uint8_t index) {
+    const uint8_t scale = getScale(index);
+    if (!segment.rendered || scale == 255) return;
+    for (uint16_t i=0;i<segment.numLeds;i++) segment.leds[i].nscale8(scale);
+}
+
+/**
+ * estimated current of the frame as limited, in mA
+ */
+uint16_t PowerLimiter::getMilliamps() {
+    return _milliamps;
+}
+
+/**
+ * estimated current of the frame before limiting, in mA
+ */
+uint16_t PowerLimiter::getDemandMilliamps() {
+    return _demand;
+}
+
+uint8_t PowerLimiter::getScale(uint8_t index) {
+    return _lowPriority & (1 << index) ? _lowScale : _highScale;
+}
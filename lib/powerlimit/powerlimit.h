@@ -0,0 +1,51 @@
+#ifndef POWER_LIMIT_H
+#define POWER_LIMIT_H
+#include <Arduino.h>
+#include "FastLED.h"
+#include "ledsegment.h"
+
+// WS2812B current of a color channel at full duty, and of an LED showing black, in mA
+#define LED_RED_MILLIAMPS 16
+#define LED_GREEN_MILLIAMPS 11
+#define LED_BLUE_MILLIAMPS 15
+#define LED_IDLE_MILLIAMPS 1
+
+/**
+ * Estimates the current of a frame and scales it to a budget.
+ *
+ * The estimate is worked out from the channel sums of the segments, which the
+ * renderers keep up to date, so it costs the same for any strip length. It
+ * follows the output path: the color correction and global brightness
+ * FastLED applies, then the per-LED model above.
+ *
+ * Segments render at full scale. If the frame would draw more than the
+ * budget, the low priority segments are scaled down first, and the others
+ * only once the low priority ones are off. update() returns true when the
+ * scales changed, and the sketch then re-renders its segments so apply() can
+ * scale them from full scale again.
+ */
+class PowerLimiter {
+    public:
+        PowerLimiter(uint16_t budgetMilliamps);
+        void setBudget(uint16_t budgetMilliamps);
+        uint16_t getBudget();
+        void setOutputScale(const CRGB& correction, uint8_t brightness);
+        bool update(const LedSegment* segments, uint8_t numSegments, uint8_t lowPriority);
+        void apply(LedSegment& segment, uint8_t index);
+        uint16_t getMilliamps();
+        uint16_t getDemandMilliamps();
+        uint8_t getScale(uint8_t index);
+    private:
+        uint32_t segmentMilliamps(const LedSegment& segment);
+        static uint8_t fitScale(uint32_t available, uint32_t demand);
+        uint16_t _budget;
+        CRGB _correction;
+        uint8_t _brightness;
+        uint8_t _lowPriority;
+        uint8_t _lowScale;
+        uint8_t _highScale;
+        uint16_t _milliamps;
+        uint16_t _demand;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "powersleep.h"
+#ifdef __AVR__
+    #include <avr/sleep.h>
+#endif
+#ifdef ESP32
+    #include <esp_sleep.h>
+    #include <driver/gpio.h>
+#endif
+
+#ifdef __AVR__
+static uint8_t wakeInterrupt;
+
+/**
+ * a low level interrupt keeps firing while the pin is held, so it detaches itself
+ */
+static void wakeInterruptFunc() {
+    detachInterrupt(wakeInterrupt);
+}
+#endif
+
+void sleepUntilLow(uint8_t pin, void (*changeInterruptFunc)()) {
+    detachInterrupt(digitalPinToInterrupt(pin));
+    #ifdef __AVR__
+        // only level and pin change interrupts wake the AVR from power-down
+        wakeInterrupt = digitalPinToInterrupt(pin);
+        set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+        noInterrupts();
+        if (digitalRead(pin)) {
+            attachInterrupt(wakeInterrupt, wakeInterruptFunc, LOW);
+            sleep_enable();
+            // interrupts are enabled by the instruction before sleep, so a press can't slip in between
+            interrupts();
+            sleep_cpu();
+            sleep_disable();
+        }
+        interrupts();
+    #elif defined(ESP32)
+        gpio_wakeup_enable((gpio_num_t) pin, GPIO_INTR_LOW_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+        if (digitalRead(pin)) esp_light_sleep_start();
+        gpio_wakeup_disable((gpio_num_t) pin);
+    #elif defined(NATIVE)
+        if (digitalRead(pin) && nativeSleepHook != NULL) nativeSleepHook(pin);
+    #endif
+    attachInterrupt(digitalPinToInterrupt(pin), changeInterruptFunc, CHANGE);
+    changeInterruptFunc();
+}
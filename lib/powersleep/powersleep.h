@@ -0,0 +1,15 @@
+#ifndef POWER_SLEEP_H
+#define POWER_SLEEP_H
+#include <Arduino.h>
+
+/**
+ * Sleep until a button pin reads low: power-down sleep on AVR, light sleep
+ * on ESP32. RAM is kept, so execution continues after the call.
+ * The pin's change interrupt is swapped for a low level wake-up while asleep
+ * and changeInterruptFunc is attached again afterwards and called once, so
+ * the button sees the press that woke it.
+ * Returns at once if the pin already reads low.
+ */
+void sleepUntilLow(uint8_t pin, void (*changeInterruptFunc)());
+
+#endif
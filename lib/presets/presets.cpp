@@ -0,0 +1,41 @@
+#include "presets.h"
+
+PresetBank::PresetBank() {
+    _active = 0;
+    memset(_packed, 0, sizeof(_packed));
+}
+
+uint8_t PresetBank::getActive() {
+    return _active < NUM_PRESETS ? _active : 0;
+}
+
+void PresetBank::setActive(uint8_t preset) {
+    _active = preset < NUM_PRESETS ? preset : 0;
+}
+
+void PresetBank::pack(uint8_t preset, const ledsConfig& config) {
+    uint8_t* packed = _packed[preset];
+    packed[0] = (config.curMode & 0x01) | (config.curBrightness & 0x03) << 1 | (config.curRGBMode & 0x07) << 3
+        | (config.autoBrightness & 0x01) << 6;
+    packed[1] = config.lenColors & 0x0F;
+    for (uint8_t i=0;i<MAX_PRESET_COLORS;i+=2) {
+        packed[2 + i / 2] = (config.curColors[i] & 0x0F) | (config.curColors[i + 1] & 0x0F) << 4;
+    }
+}
+
+/**
+ * lenColors is limited to MAX_PRESET_COLORS in case the bank holds garbage
+ */
+void PresetBank::unpack(uint8_t preset, ledsConfig& config) {
+    const uint8_t* packed = _packed[preset];
+    config.curMode = packed[0] & 0x01;
+    config.curBrightness = (packed[0] >> 1) & 0x03;
+    config.curRGBMode = (packed[0] >> 3) & 0x07;
+    config.autoBrightness = (packed[0] >> 6) & 0x01;
+    config.lenColors = packed[1] & 0x0F;
+    if (config.lenColors > MAX_PRESET_COLORS) config.lenColors = MAX_PRESET_COLORS;
+    for (uint8_t i=0;i<MAX_PRESET_COLORS;i+=2) {
+        config.curColors[i] = packed[2 + i / 2] & 0x0F;
+        config.curColors[i + 1] = packed[2 + i / 2] >> 4;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef PRESETS_H
+#define PRESETS_H
+#include <Arduino.h>
+
+#define NUM_PRESETS 8
+#define MAX_PRESET_COLORS 10
+#define PACKED_PRESET_SIZE 7
+
+/**
+ * curMode - either MODE_NORM or MODE_NORMPLUSRGB
+ *    MODE_NORM - only front and rear lights on
+ *    MODE_NORMPLUSRGB - front, rear, and RGB lights on
+ * curBrightness - global brightness of all lights
+ *    - either PWR_OFF, PWR_LOW, PWR_MED, or PWR_HIGH
+ * curColors - array of colors in that mode
+ *    - can contain anywhere between 0 to 10 colors, indices inside HUE_VALUES
+ *    - length of colors is in lenColors
+ * curRGBMode - current RGB mode
+ *    - can be either RGBMODE_CONSTANT, RGBMODE_SINGLEFLASH, RGBMODE_DOUBLEFLASH,
+ *      RGBMODE_SINGLEFADE, RGBMODE_DOUBLEFADE, RGBMODE_FORWARDSHIFT,
+ *      RGBMODE_REVERSESHIFT
+ * autoBrightness - 1 if the light sensor sets curBrightness
+ */
+struct ledsConfig {
+    byte curMode;
+    byte curBrightness;
+    byte curColors[MAX_PRESET_COLORS];
+    byte lenColors;
+    byte curRGBMode;
+    byte autoBrightness;
+};
+
+/**
+ * NUM_PRESETS configs, bit-packed, and the one in use.
+ * A packed preset is PACKED_PRESET_SIZE bytes:
+ *    byte 0 - bit 0 curMode, bits 1-2 curBrightness, bits 3-5 curRGBMode,
+ *             bit 6 autoBrightness
+ *    byte 1 - bits 0-3 lenColors
+ *    bytes 2-6 - curColors, 4 bits each, low nibble first
+ * Only the active preset is unpacked into a ledsConfig, so switching presets
+ * costs the same whichever is selected. The bank is plain data and is saved
+ * as it is.
+ */
+class PresetBank {
+    public:
+        PresetBank();
+        uint8_t getActive();
+        void setActive(uint8_t preset);
+        void pack(uint8_t preset, const ledsConfig& config);
+        void unpack(uint8_t preset, ledsConfig& config);
+    private:
+        uint8_t _active;
+        uint8_t _packed[NUM_PRESETS][PACKED_PRESET_SIZE];
+};
+
+#endif
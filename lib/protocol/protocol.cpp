@@ -0,0 +1,181 @@
+#include "protocol.h"
+
+ProtocolCodec::ProtocolCodec(void (*writeFunc)(const uint8_t* data, uint8_t len)) {
+    _writeFunc = writeFunc;
+    _rxLen = 0;
+    _rxCrc = 0xFFFF;
+    _receiving = false;
+    _rxTime = 0;
+    _fieldPos = 0;
+    _txLen = 0;
+    _framesReceived = 0;
+    _framesDropped = 0;
+}
+
+/**
+ * take the next received byte.
+ * returns true when it completed a frame, which stays readable until the
+ * next feed().
+ */
+bool ProtocolCodec::feed(uint8_t c) {
+    if (!_receiving) {
+        if (c != PROTOCOL_SYNC) return false;
+        _receiving = true;
+        // the timeout runs from the sync byte, the link may have been idle for long before it
+        _rxTime = millis();
+        _rxLen = 0;
+        _rxCrc = 0xFFFF;
+        return false;
+    }
+    _rxTime = millis();
+    const uint8_t pos = _rxLen++;
+    _rx[pos] = c;
+    if (pos == 1 && (c < 2 || c > PROTOCOL_MAX_BODY)) return drop();
+    // version, length and body are covered by the CRC
+    if (pos < 2 || pos < 2 + _rx[1]) {
+        _rxCrc = crc16(_rxCrc, c);
+        return false;
+    }
+    if (pos < 3 + _rx[1]) return false;
+    _receiving = false;
+    if (_rxCrc != (_rx[pos - 1] | (_rx[pos] << 8))) return drop();
+    _framesReceived++;
+    rewindFields();
+    return true;
+}
+
+/**
+ * drop a frame that stopped coming in for PROTOCOL_TIMEOUT ms, call it from
+ * the loop. returns true if a frame is complete after all, see drop().
+ */
+bool ProtocolCodec::checkTimeout() {
+    if (!_receiving || millis() - _rxTime < PROTOCOL_TIMEOUT) return false;
+    return drop();
+}
+
+/**
+ * drop the frame being received. a frame may have started among its bytes,
+ * e.g. after line noise that looked like a sync byte, so they are fed again
+ * from the first sync byte in them. feed() only writes below the byte being
+ * fed again, so this works in place.
+ * returns true if that completes a frame; bytes after it are lost.
+ */
+bool ProtocolCodec::drop() {
+    const uint8_t len = _rxLen;
+    _receiving = false;
+    _framesDropped++;
+    for (uint8_t i=0;i<len;i++) {
+        if (_rx[i] != PROTOCOL_SYNC) continue;
+        for (uint8_t k=i;k<len;k++) {
+            if (feed(_rx[k])) return true;
+        }
+        break;
+    }
+    return false;
+}
+
+/**
+ * true while a frame is partly received
+ */
+bool ProtocolCodec::receiving() {
+    return _receiving;
+}
+
+uint8_t ProtocolCodec::getVersion() {
+    return _rx[0];
+}
+
+uint8_t ProtocolCodec::getSequence() {
+    return _rx[2];
+}
+
+uint8_t ProtocolCodec::getCommand() {
+    return _rx[3];
+}
+
+/**
+ * the next field of the received frame.
+ * returns false after the last field, or at a field that runs past the body.
+ */
+bool ProtocolCodec::nextField(ProtocolField& field) {
+    const uint8_t end = 2 + _rx[1];
+    if (_fieldPos + 2 > end || _fieldPos + 2 + _rx[_fieldPos + 1] > end) return false;
+    field.id = _rx[_fieldPos];
+    field.len = _rx[_fieldPos + 1];
+    field.value = &_rx[_fieldPos + 2];
+    _fieldPos += 2 + field.len;
+    return true;
+}
+
+/**
+ * make nextField() start over at the first field
+ */
+void ProtocolCodec::rewindFields() {
+    _fieldPos = 4;
+}
+
+void ProtocolCodec::beginFrame(uint8_t sequence, uint8_t command) {
+    _tx[0] = PROTOCOL_SYNC;
+    _tx[1] = PROTOCOL_VERSION;
+    _tx[3] = sequence;
+    _tx[4] = command;
+    _txLen = 5;
+}
+
+/**
+ * start the response to the received frame
+ */
+void ProtocolCodec::beginResponse(uint8_t status) {
+    beginFrame(getSequence(), getCommand() | PROTOCOL_RESPONSE);
+    addField(FIELD_STATUS, status);
+}
+
+/**
+ * returns false if the field doesn't fit in the frame
+ */
+bool ProtocolCodec::addField(uint8_t id, const uint8_t* value, uint8_t len) {
+    if (_txLen + 2 + len + 2 > (int) sizeof(_tx)) return false;
+    _tx[_txLen++] = id;
+    _tx[_txLen++] = len;
+    memcpy(&_tx[_txLen], value, len);
+    _txLen += len;
+    return true;
+}
+
+bool ProtocolCodec::addField(uint8_t id, uint8_t value) {
+    return addField(id, &value, 1);
+}
+
+/**
+ * finish the frame and send it
+ */
+void ProtocolCodec::endFrame() {
+    _tx[2] = _txLen - 3;
+    uint16_t crc = 0xFFFF;
+    for (uint8_t i=1;i<_txLen;i++) crc = crc16(crc, _tx[i]);
+    _tx[_txLen++] = crc;
+    _tx[_txLen++] = crc >> 8;
+    _writeFunc(_tx, _txLen);
+}
+
+unsigned long ProtocolCodec::getFramesReceived() {
+    return _framesReceived;
+}
+
+/**
+ * frames dropped for a bad length or CRC
+ */
+unsigned long ProtocolCodec::getFramesDropped() {
+    return _framesDropped;
+}
+
+/**
+ * CRC-16/CCITT-FALSE, one byte at a time
+ */
+uint16_t ProtocolCodec::crc16(uint16_t crc, uint8_t c) {
+    crc ^= (uint16_t) c << 8;
+    for (uint8_t bit=0;bit<8;bit++) {
+        crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
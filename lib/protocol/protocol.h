@@ -0,0 +1,126 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+#include <Arduino.h>
+
+/**
+ * Binary control protocol, the same over every transport.
+ *
+ * A frame is
+ *    PROTOCOL_SYNC, version, body length, body, CRC-16 of version to body end (LE)
+ * and its body is
+ *    sequence number, command, fields
+ * Each field is an id, a value length and the value. A response carries the
+ * command with PROTOCOL_RESPONSE set, the sequence number of the request, and
+ * FIELD_STATUS as its first field.
+ *
+ *    CMD_PING - answered with FIELD_STATUS and FIELD_VERSION
+ *    CMD_GET - fields with empty values name the fields to answer with, no
+ *       fields asks for all of them
+ *    CMD_SET - fields to change. they are all checked before any is applied,
+ *       and applied in order, so FIELD_PRESET first applies the rest to the
+ *       new preset
+ * Fields with an id the receiver doesn't know are skipped on GET and
+ * rejected on SET.
+ */
+#define PROTOCOL_SYNC 0xA5
+#define PROTOCOL_VERSION 1
+// longest body, sequence number and command included
+#define PROTOCOL_MAX_BODY 48
+// sync, version, length and CRC
+#define PROTOCOL_OVERHEAD 5
+#define PROTOCOL_RESPONSE 0x80
+// a frame that stops coming in for this long is dropped, in ms
+#define PROTOCOL_TIMEOUT 50
+
+enum PROTOCOLCOMMAND {
+    CMD_PING = 0,
+    CMD_GET,
+    CMD_SET,
+};
+
+enum PROTOCOLSTATUS {
+    STATUS_OK = 0,
+    STATUS_BAD_VERSION,
+    STATUS_BAD_COMMAND,
+    STATUS_BAD_FIELD,
+    STATUS_BAD_VALUE,
+};
+
+/**
+ * FIELD_STATUS - PROTOCOLSTATUS of a response
+ * FIELD_VERSION - protocol version
+ * FIELD_POWER - brightness, PWR_OFF to PWR_HIGH
+ * FIELD_MODE - MODE_NORM or MODE_NORMPLUSRGB
+ * FIELD_RGBMODE - RGBMODE_CONSTANT to RGBMODE_REVERSESHIFT
+ * FIELD_PALETTE - 1 to 10 color indices
+ * FIELD_PRESET - active preset
+ * FIELD_AUTO - 1 if the light sensor sets the brightness
+ */
+enum PROTOCOLFIELD {
+    FIELD_STATUS = 0,
+    FIELD_VERSION,
+    FIELD_POWER,
+    FIELD_MODE,
+    FIELD_RGBMODE,
+    FIELD_PALETTE,
+    FIELD_PRESET,
+    FIELD_AUTO,
+    NUM_FIELDS,
+};
+
+/**
+ * a field of a received frame, its value points into the receive buffer
+ */
+struct ProtocolField {
+    uint8_t id;
+    uint8_t len;
+    const uint8_t* value;
+};
+
+/**
+ * Frames bytes in and out for one transport.
+ * feed() takes the received bytes one at a time into a fixed buffer and
+ * checks the CRC as they come, so a finished frame is parsed in place:
+ * nextField() walks its fields without copying them. Frames with a bad CRC
+ * or length, or that stall, are dropped and the codec looks for the next
+ * PROTOCOL_SYNC.
+ * Frames are sent through writeFunc, e.g. to Serial or a BLE characteristic.
+ */
+class ProtocolCodec {
+    public:
+        ProtocolCodec(void (*writeFunc)(const uint8_t* data, uint8_t len));
+        bool feed(uint8_t c);
+        bool checkTimeout();
+        bool receiving();
+        uint8_t getVersion();
+        uint8_t getSequence();
+        uint8_t getCommand();
+        bool nextField(ProtocolField& field);
+        void rewindFields();
+        void beginFrame(uint8_t sequence, uint8_t command);
+        void beginResponse(uint8_t status);
+        bool addField(uint8_t id, const uint8_t* value, uint8_t len);
+        bool addField(uint8_t id, uint8_t value);
+        void endFrame();
+        unsigned long getFramesReceived();
+        unsigned long getFramesDropped();
+    private:
+        bool drop();
+        static uint16_t crc16(uint16_t crc, uint8_t c);
+        void (*_writeFunc)(const uint8_t* data, uint8_t len);
+        // receive buffer, from the version byte to the end of the CRC
+        uint8_t _rx[PROTOCOL_MAX_BODY + PROTOCOL_OVERHEAD - 1];
+        uint8_t _rxLen;
+        uint16_t _rxCrc;
+        bool _receiving;
+        // millis() of the last byte received
+        unsigned long _rxTime;
+        // next field nextField() returns
+        uint8_t _fieldPos;
+        uint8_t _tx[PROTOCOL_MAX_BODY + PROTOCOL_OVERHEAD];
+        uint8_t _txLen;
+        unsigned long _framesReceived;
+        unsigned long _framesDropped;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "stagetimer.h"
+
+StageTimer::StageTimer() {
+    _lastTime = 0;
+    reset();
+}
+
+/**
+ * current time in ticks
+ */
+uint32_t StageTimer::now() {
+    #ifdef ESP32
+        return ESP.getCycleCount();
+    #else
+        return micros();
+    #endif
+}
+
+uint32_t StageTimer::ticksPerMicro() {
+    #ifdef ESP32
+        return ESP.getCpuFreqMHz();
+    #else
+        return 1;
+    #endif
+}
+
+void StageTimer::record(uint32_t ticks) {
+    if (ticks < _minTicks) _minTicks = ticks;
+    if (ticks > _maxTicks) _maxTicks = ticks;
+    _sumTicks += ticks;
+    _count++;
+    uint32_t us = ticks / ticksPerMicro();
+    uint8_t bucket = 0;
+    while (bucket < STAGE_TIMER_BUCKETS - 1 && us >= (4UL << bucket)) bucket++;
+    if (_histogram[bucket] != 0xFFFF) _histogram[bucket]++;
+}
+
+/**
+ * record the time since the previous call, e.g. to measure loop-to-loop jitter.
+ * the first call after a reset only sets the starting point.
+ */
+void StageTimer::recordInterval(uint32_t time) {
+    if (_lastTime) record(time - _lastTime);
+    _lastTime = time;
+}
+
+/**
+ * print the stats in microseconds, on one line, after a name in flash, e.g. F("show")
+ */
+void StageTimer::print(const __FlashStringHelper* name) {
+    float ticksPerMicroF = ticksPerMicro();
+    Serial.print(name);
+    Serial.print(F(" n="));
+    Serial.print(_count);
+    if (_count) {
+        Serial.print(F(" min="));
+        Serial.print(_minTicks / ticksPerMicroF);
+        Serial.print(F(" mean="));
+        Serial.print((float) (_sumTicks / _count) / ticksPerMicroF);
+        Serial.print(F(" max="));
+        Serial.print(_maxTicks / ticksPerMicroF);
+    }
+    Serial.print(F(" hist="));
+    for (int i=0;i<STAGE_TIMER_BUCKETS;i++) {
+        if (i) Serial.print(',');
+        Serial.print(_histogram[i]);
+    }
+    Serial.println();
+}
+
+void StageTimer::reset() {
+    _minTicks = 0xFFFFFFFF;
+    _maxTicks = 0;
+    _sumTicks = 0;
+    _count = 0;
+    _lastTime = 0;
+    for (int i=0;i<STAGE_TIMER_BUCKETS;i++) _histogram[i] = 0;
+}
@@ -0,0 +1,45 @@
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+#include <Arduino.h>
+
+#define STAGE_TIMER_BUCKETS 12
+
+/**
+ * Duration statistics of one stage of the main loop: min, max, mean and a
+ * histogram with power of two buckets, bucket i counting durations below
+ * 4 << i us and the last bucket everything longer.
+ * Durations are measured in ticks of the CPU cycle counter on ESP32 and of
+ * micros() elsewhere.
+ *
+ * Use the STAGE_TIMER_* macros, which compile to nothing unless STAGE_TIMING
+ * is defined before this header is included.
+ */
+class StageTimer {
+    public:
+        StageTimer();
+        static uint32_t now();
+        static uint32_t ticksPerMicro();
+        void record(uint32_t ticks);
+        void recordInterval(uint32_t time);
+        void print(const __FlashStringHelper* name);
+        void reset();
+    private:
+        uint32_t _minTicks;
+        uint32_t _maxTicks;
+        uint64_t _sumTicks;
+        uint32_t _count;
+        uint32_t _lastTime;
+        uint16_t _histogram[STAGE_TIMER_BUCKETS];
+};
+
+#ifdef STAGE_TIMING
+    #define STAGE_TIMER_BEGIN(timer) uint32_t timer##Start = StageTimer::now()
+    #define STAGE_TIMER_END(timer) timer.record(StageTimer::now() - timer##Start)
+    #define STAGE_TIMER_INTERVAL(timer) timer.recordInterval(StageTimer::now())
+#else
+    #define STAGE_TIMER_BEGIN(timer)
+    #define STAGE_TIMER_END(timer)
+    #define STAGE_TIMER_INTERVAL(timer)
+#endif
+
+#endif
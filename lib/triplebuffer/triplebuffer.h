@@ -0,0 +1,58 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+#include <Arduino.h>
+
+/**
+ * Lock-free exchange of triple buffered frames between one producer and one
+ * consumer, e.g. a render task and an output task on different cores.
+ * The producer always owns the back buffer and the consumer the front buffer.
+ * The third buffer holds the latest published frame. Publishing and taking a
+ * frame are single atomic exchanges, so neither side ever waits for the other
+ * and the consumer never sees a half written frame. Only buffer indices are
+ * exchanged; the buffers themselves belong to the caller.
+ */
+class TripleBuffer {
+    public:
+        TripleBuffer() : _back(0), _ready(1), _front(2) {}
+
+        /**
+         * buffer the producer renders into
+         */
+        uint8_t backIndex() {
+            return _back;
+        }
+
+        /**
+         * hand the back buffer to the consumer and take over the buffer it replaces.
+         * an unconsumed frame is dropped in favour of the newer one.
+         */
+        void publish() {
+            _back = __atomic_exchange_n(&_ready, (uint8_t)(_back | FRESH), __ATOMIC_ACQ_REL) & INDEX_MASK;
+        }
+
+        /**
+         * swap in the latest published frame as the front buffer.
+         * returns false if nothing was published since the last call.
+         */
+        bool takeFresh() {
+            if (!(__atomic_load_n(&_ready, __ATOMIC_ACQUIRE) & FRESH)) return false;
+            _front = __atomic_exchange_n(&_ready, _front, __ATOMIC_ACQ_REL) & INDEX_MASK;
+            return true;
+        }
+
+        /**
+         * buffer the consumer is showing
+         */
+        uint8_t frontIndex() {
+            return _front;
+        }
+
+    private:
+        static const uint8_t INDEX_MASK = 0x03;
+        static const uint8_t FRESH = 0x80;
+        uint8_t _back;
+        uint8_t _ready;
+        uint8_t _front;
+};
+
+#endif
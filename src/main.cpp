@@ -68,18 +68,48 @@
  *    
  */
 
-// #define AVR
-#define ESP32
+// the target comes from the toolchain: avr-gcc defines __AVR__, the ESP32 core ESP32.
+// the native environment builds for the host and takes the AVR code paths
+#if defined(__AVR__) && !defined(AVR)
+  #define AVR
+#endif
+#if !defined(AVR) && !defined(ESP32) && !defined(NATIVE)
+  #error "unknown target, build for AVR, ESP32 or NATIVE"
+#endif
+
+// serial speed; frame streaming needs 1000000 or 2000000, which the host has to match
+#ifndef SERIAL_BAUD
+  #define SERIAL_BAUD 115200
+#endif
+
+// define STAGE_TIMING to time the loop stages; send 't' over serial to print and reset the stats
+// #define STAGE_TIMING
+
+// records below LOG_LEVEL compile to nothing, LOG_LEVEL_NONE leaves out the log too
+// #define LOG_LEVEL LOG_LEVEL_DEBUG
 
 #include <Arduino.h>
 #include "buttonlib2.h"
+#include "ledsegment.h"
+#include "framescheduler.h"
+#include "animation.h"
+#include "rgbmodes.h"
+#include "stagetimer.h"
+#include "configstore.h"
+#include "presets.h"
+#include "powersleep.h"
+#include "powerlimit.h"
+#include "adcsampler.h"
+#include "battery.h"
+#include "lightsensor.h"
+#include "protocol.h"
+#include "framestream.h"
+#include "eventlog.h"
 #include "FastLED.h"
-#ifdef AVR
-  #include "EEPROM.h"
-#endif
-#ifdef ESP32
-  #include <Preferences.h>
-  Preferences prefs;
+// define DUAL_CORE_RENDER on ESP32 to render frames in a task on the core the loop doesn't use
+// #define DUAL_CORE_RENDER
+#if defined(ESP32) && defined(DUAL_CORE_RENDER)
+  #include "triplebuffer.h"
 #endif
 
 /** 
@@ -103,25 +133,6 @@ enum MODESTATE {
   MODE_NORM = 0, 
   MODE_NORMPLUSRGB,
 };
-/**
- * RGB modes
- *    constant on, 
- *    single flash, 
- *    double flash, 
- *    single fade, 
- *    double fade, 
- *    forward shift, 
- *    reverse shift
- */
-enum RGBMODESTATE {
-  RGBMODE_CONSTANT = 0, 
-  RGBMODE_SINGLEFLASH, 
-  RGBMODE_DOUBLEFLASH, 
-  RGBMODE_SINGLEFADE, 
-  RGBMODE_DOUBLEFADE, 
-  RGBMODE_FORWARDSHIFT, 
-  RGBMODE_REVERSESHIFT,
-};
 // constant hue and saturation values for front and rear lights
 const byte WHITE_HUE = 0;
 const byte WHITE_SATURATION = 0;
@@ -130,138 +141,280 @@ const byte RED_SATURATION = 255;
 
 // red, orange, yellow, yellowgreen, green, bluegreen, cyan, blue, violet, purple, white, black
 // constant values for changing hue and saturation
-const byte HUE_VALUES[] = {0, 24, 48, 80, 96, 128, 144, 160, 192, 224, 255, 0};
+// the tables indexed at run time are in PROGMEM, so they don't take RAM on AVR
+const byte HUE_VALUES[] PROGMEM = {0, 24, 48, 80, 96, 128, 144, 160, 192, 224, 255, 0};
 const byte WHITE_HUE_INDEX = 10;
 const byte BLACK_HUE_INDEX = WHITE_HUE_INDEX + 1;
-const byte BRIGHTNESS_VALUES[] = {0, 80, 160, 250};
-
-/**
- * curMode - either MODE_NORM or MODE_NORMPLUSRGB
- *    MODE_NORM - only front and rear lights on
- *    MODE_NORMPLUSRGB - front, rear, and RGB lights on
- * curBrightness - global brightness of all lights
- *    - either PWR_OFF, PWR_LOW, PWR_MED, or PWR_HIGH
- * curColors - array of colors in that mode
- *    - can contain anywhere between 0 to 10 colors, indices inside HUE_VALUES
- *    - length of colors is in lenColors
- * curRGBMode - current RGB mode
- *    - can be either RGBMODE_CONSTANT, RGBMODE_SINGLEFLASH, RGBMODE_DOUBLEFLASH,
- *      RGBMODE_SINGLEFADE, RGBMODE_DOUBLEFADE, RGBMODE_FORWARDSHIFT, 
- *      RGBMODE_REVERSESHIFT
- */ 
-struct ledsConfig {
-  byte curMode;
-  byte curBrightness;
-  byte curColors[10];
-  int lenColors;
-  byte curRGBMode;
-  byte checkByte;
-};
+const byte BRIGHTNESS_VALUES[] PROGMEM = {0, 80, 160, 250};
 
-#ifdef AVR
+/**
+ * three strings of LEDs: front, side, and rear
+ * the side and rear strings are chained after the front string on LED_PIN,
+ * unless SIDE_LED_PIN or REAR_LED_PIN give them a data pin of their own.
+ * on ESP32, strings on separate pins are sent in parallel by the RMT driver,
+ * or by the I2S driver if FASTLED_ESP32_I2S is defined before FastLED.h.
+ * LED_POWER_PIN, if defined, switches the strings' supply, high is on.
+ * it is switched off while the MCU sleeps with the lights off.
+ * BATTERY_PIN reads the pack through a divider; BATTERY_FULL_SCALE_MV is the
+ * pack voltage that reads as full scale.
+ * LDR_PIN reads an LDR from the supply over a 10k resistor to ground, so
+ * brighter light reads higher.
+ */
+#if defined(AVR) || defined(NATIVE)
   // 1 button
   const int BTN1_PIN = 2;
-  // three strings of LEDs: front, side, and rear
   const int LED_PIN = 4;
+  // #define SIDE_LED_PIN 5
+  // #define REAR_LED_PIN 6
+  // #define LED_POWER_PIN 7
+  // 100k over 47k, 5 V reference
+  const int BATTERY_PIN = A0;
+  const uint16_t BATTERY_FULL_SCALE_MV = 15638;
+  const int LDR_PIN = A1;
 #endif 
 #ifdef ESP32
   // 1 button
   const int BTN1_PIN = 18;
-  // three strings of LEDs: front, side, and rear
   const int LED_PIN = 2;
+  // #define SIDE_LED_PIN 4
+  // #define REAR_LED_PIN 5
+  // #define LED_POWER_PIN 15
+  // 100k over 22k, 3.3 V full scale; an ADC1 pin, ADC2 is taken by the radio
+  const int BATTERY_PIN = 34;
+  const uint16_t BATTERY_FULL_SCALE_MV = 18300;
+  const int LDR_PIN = 35;
 #endif 
 
 // control button
 InterruptButton btn1(BTN1_PIN);
+// a single click waits this long for a second one, so keep it short for quick brightness changes
+const uint16_t BTN1_MULTICLICK_DURATION = 350;
+/**
+ * 3S pack voltages in mV below which the lights are derated one step each.
+ * the brightness is capped at BATTERY_BRIGHTNESS_CAPS[step]; the last step is
+ * the reserve, on which only the rear light stays on.
+ */
+const uint16_t BATTERY_STEP_MV[] PROGMEM = {10800, 10200, 9600};
+const byte BATTERY_BRIGHTNESS_CAPS[] PROGMEM = {PWR_HIGH, PWR_MED, PWR_LOW, PWR_LOW};
+const byte BATTERY_RESERVE_STEP = 3;
+// a step is taken back once the pack is this far above its voltage again
+const uint16_t BATTERY_RECOVER_MV = 300;
+// the pack voltage is filtered over a few seconds, so load transients don't derate
+const uint16_t BATTERY_TIME_CONSTANT = 4000;
+/**
+ * light sensor thresholds in ADC counts, from dark to bright, and the
+ * brightness each ambient level sets while autoBrightness is on
+ */
+const uint16_t LDR_THRESHOLDS[] PROGMEM = {ADC_SAMPLER_MAX / 10, ADC_SAMPLER_MAX * 3 / 10, ADC_SAMPLER_MAX * 6 / 10};
+const byte LDR_BRIGHTNESS[] PROGMEM = {PWR_HIGH, PWR_MED, PWR_LOW, PWR_OFF};
+const uint16_t LDR_HYSTERESIS = ADC_SAMPLER_MAX / 25;
+const uint16_t LDR_TIME_CONSTANT = 2000;
+// an ambient level has to hold this long to change the brightness, longer than a streetlight takes to pass
+const uint16_t LDR_HOLD_TIME = 5000;
+// samples the battery and the light sensor in the background
+AdcSampler adcSampler;
+BatteryMonitor battery(adcSampler, BATTERY_PIN, BATTERY_FULL_SCALE_MV);
+LightSensor lightSensor(adcSampler, LDR_PIN);
 // FastLED stuff
-const int NUM_LEDS = 8;
+const int NUM_FRONT_LEDS = 4;
+const int NUM_SIDE_LEDS = 4;
+const int NUM_REAR_LEDS = 4;
+const int NUM_LEDS = NUM_FRONT_LEDS + NUM_SIDE_LEDS + NUM_REAR_LEDS;
 const int BRIGHTNESS = 250;
+// current the LEDs may draw in mA, what the boost converters can deliver
+const uint16_t LED_CURRENT_BUDGET = 1500;
 #define COLOR_ORDER GRB
 #define LED_TYPE WS2812B
-#define UPDATES_PER_SECOND 100
+// frame rate of the LED loop; the fastest RGB mode steps every 5 ms
+#define UPDATES_PER_SECOND 200
+// define FRAME_STATS to print frame scheduler stats every FRAME_STATS_INTERVAL ms
+// #define FRAME_STATS
+#define FRAME_STATS_INTERVAL 5000
 CRGB leds[NUM_LEDS];
-CRGB* frontLeds = &leds[0];
-CRGB* rgbLeds = &leds[NUM_LEDS/2];
-
-// update period for fading modes
-unsigned int updatePeriodinMillis = 5;
-// period length for all RGB modes
-int totalPeriodLengthinMillis = 1000;
-// keypoints per RGB mode cycle that determine the behavior for each RGB mode
-unsigned int keyPoints[6];
-// flashCycleTimer - used to keep time in RGB modes
-unsigned long flashCycleTimer;
-/**
- * ctr1 is a counter variable used to animate the LEDs.
- * ctr1 is measured in multiples of updatePeriodinMillis milliseconds, which varies 
- * depending on the RGB mode. For example, it could be in multiples of 5 ms for fading, or 100 ms
- * for flashing.
- */
-unsigned int ctr1;
-
-ledsConfig* configuration;
-byte buff[sizeof(ledsConfig)];
+
+/**
+ * LED segments in the frame buffer, in data line order
+ */
+enum LEDSEGMENT {
+  SEGMENT_FRONT = 0, 
+  SEGMENT_SIDE, 
+  SEGMENT_REAR, 
+  NUM_SEGMENTS,
+};
+// FastLED controller of each segment; chained segments share the controller of their data line
+#ifdef SIDE_LED_PIN
+  const uint8_t SIDE_CONTROLLER = 1;
+#else
+  const uint8_t SIDE_CONTROLLER = 0;
+#endif
+#ifdef REAR_LED_PIN
+  const uint8_t REAR_CONTROLLER = SIDE_CONTROLLER + 1;
+#else
+  const uint8_t REAR_CONTROLLER = SIDE_CONTROLLER;
+#endif
+LedSegment segments[NUM_SEGMENTS] = {
+  {&leds[0], NUM_FRONT_LEDS, 0, false, 0, {0, 0, 0}},
+  {&leds[NUM_FRONT_LEDS], NUM_SIDE_LEDS, SIDE_CONTROLLER, false, 0, {0, 0, 0}},
+  {&leds[NUM_FRONT_LEDS + NUM_SIDE_LEDS], NUM_REAR_LEDS, REAR_CONTROLLER, false, 0, {0, 0, 0}},
+};
+// brightness level and battery step the front and rear lights were last rendered at
+byte frLEDsLevel = 0xFF;
+byte frLEDsStep;
+// true while the RGB LEDs are rendered off
+bool rgbLEDsOff;
+// scales the frame to LED_CURRENT_BUDGET, the RGB LEDs before the front and rear lights
+PowerLimiter powerLimiter(LED_CURRENT_BUDGET);
+// set when the power limit changed or a stream ended, so the lights are rendered again at full scale
+bool rerenderLEDs;
+FrameScheduler frameScheduler(UPDATES_PER_SECOND);
+#ifdef FRAME_STATS
+  unsigned long lastFrameStatsTime;
+#endif
+// micros() when the first frame was shown, counted from the start of the core
+unsigned long firstLightMicros;
+#if defined(ESP32) && defined(DUAL_CORE_RENDER)
+  /**
+   * the render task renders into leds and copies finished frames into the back
+   * buffer; the loop shows the front buffer. frameExchange swaps them without locks.
+   */
+  CRGB frameBuffers[3][NUM_LEDS];
+  TripleBuffer frameExchange;
+  TaskHandle_t renderTaskHandle;
+  // time spent working on the render core and on the output/input core since the last stats print
+  volatile unsigned long renderBusyMicros;
+  volatile unsigned long outputBusyMicros;
+#endif
+
+#ifdef STAGE_TIMING
+  // durations of the loop stages and the time between loop() calls
+  StageTimer ledLoopTimer;
+  StageTimer showTimer;
+  StageTimer buttonTimer;
+  StageTimer saveTimer;
+  StageTimer sensorTimer;
+  StageTimer loopIntervalTimer;
+  // time from waking up to the next frame being shown
+  StageTimer wakeTimer;
+  uint32_t wakeTicks;
+#endif
+
+// animates the RGB LEDs in the current RGB mode
+AnimationEngine rgbAnimation;
+// pixels of the shift modes, as a ring buffer
+CRGB rgbShiftRing[NUM_SIDE_LEDS];
+
+/**
+ * pixel color of a palette color at a brightness value
+ * white is unsaturated and black is always off
+ */
+CRGB paletteColor(byte colorIndex, byte brightnessVal) {
+  if (colorIndex == BLACK_HUE_INDEX) return CRGB(0, 0, 0);
+  return CHSV(pgm_read_byte(&HUE_VALUES[colorIndex]), colorIndex == WHITE_HUE_INDEX? 0 : 255, brightnessVal);
+}
+
+// the active preset's colors as pixel colors, converted again when they or the brightness change
+Palette rgbPalette(paletteColor);
+
+// the active preset, unpacked
+ledsConfig configuration;
+// the copy of configuration a frame is rendered with, at the requested brightness, see takeConfig()
+ledsConfig renderConfig;
+#if defined(ESP32) && defined(DUAL_CORE_RENDER)
+  // configuration as last published by the loop core, guarded by configLock
+  ledsConfig sharedConfig;
+  portMUX_TYPE configLock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+// all presets, packed; this is what is saved
+PresetBank presets;
 unsigned long lastTimeConfigChanged;
 bool configChanged;
 const unsigned long AUTOSAVE_DELAY = 20000;
 const int configAddr = 0x00;
+/**
+ * the config is saved as a log of records spread over CONFIG_SLOTS slots,
+ * so each slot is written once every CONFIG_SLOTS saves
+ */
+#if defined(AVR) || defined(NATIVE)
+  const uint8_t CONFIG_SLOTS = 16;
+#endif
+#ifdef ESP32
+  const uint8_t CONFIG_SLOTS = 8;
+#endif
+ConfigStore configStore(sizeof(PresetBank), CONFIG_SLOTS, configAddr);
+// a record is the bank plus a sequence number and a CRC
+static_assert(sizeof(PresetBank) + 4 <= CONFIG_STORE_MAX_RECORD, "PresetBank doesn't fit a config record");
+
+/**
+ * control protocol over Serial, next to the debug text.
+ * a BLE transport would add a codec of its own that writes to its characteristic.
+ */
+void writeSerial(const uint8_t* data, uint8_t len) {
+  Serial.write(data, len);
+}
+ProtocolCodec serialCodec(writeSerial);
+/**
+ * a host that sent a control frame within CONTROL_LINK_TIME ms keeps the MCU
+ * awake, so it can turn the lights back on. the sleep only wakes on btn1: the
+ * UART can't wake an AVR from power-down, and the first bytes would be lost
+ * on ESP32. a host that wants to stay in control sends a PING now and then.
+ */
+unsigned long lastControlTime;
+bool controlLink;
+const unsigned long CONTROL_LINK_TIME = 10000;
+
+#if LOG_LEVEL > LOG_LEVEL_NONE
+  /**
+   * status text is queued as short records and written out by drainLog()
+   * while the loop has nothing else to do
+   */
+  EventLog eventLog;
+#endif
 
 /**
- * current hue and saturation variables to be written to LEDs
+ * frames streamed from a host over Serial replace the rendered lights from
+ * the first valid frame header until no frame has come in for STREAM_IDLE_TIME ms
  */
-byte curHueIndex;
-byte curHueVal;
-byte curSaturationVal;
-byte curBrightnessVal;
+FrameStream frameStream(leds, NUM_LEDS);
+// read by the render task too
+volatile bool streaming;
+unsigned long lastStreamTime;
+const unsigned long STREAM_IDLE_TIME = 2000;
+#if defined(ESP32) && defined(DUAL_CORE_RENDER)
+  // set by the render task while it is parked for a stream, see startStreaming()
+  volatile bool renderParked;
+#endif
 
 // btn1 interrupt function
-void btn1_change_func() {
+void IRAM_ATTR btn1_change_func() {
   btn1.changeInterruptFunc();
 }
 
 void printConfiguration() {
-  #ifdef ESP32
-    Serial.printf("LED configuration:\n");
-    Serial.printf("configuration->curmode=%d\n", configuration->curMode);
-    Serial.printf("configuration->curBrightness=%d\n", configuration->curBrightness);
-    Serial.printf("configuration->lenColors=%d\n", configuration->lenColors);
-    Serial.printf("configuration->curColors");
-    for (int i=0;i<configuration->lenColors;i++) {
-      Serial.printf("%d, ", configuration->curColors[i]);
-    }
-    Serial.println();
-    Serial.printf("configuration->curRGBMode=%d\n", configuration->curRGBMode);
-    Serial.printf("configuration->checkByte=%d\n", configuration->checkByte);
-  #endif
+  LOG_INFO(eventLog, F("preset=% mode=% brightness=% rgbMode=% auto=%"), presets.getActive(),
+    configuration.curMode, configuration.curBrightness, configuration.curRGBMode, configuration.autoBrightness);
+  LOG_INFO(eventLog, F("colors="), configuration.curColors, configuration.lenColors);
+  LOG_INFO(eventLog, F("record slot=% sequence=%"), configStore.getSlot(), configStore.getSequence());
 }
 
 /**
  * Load LED config from EEPROM
+ * returns false if no intact config was saved
  */
-void loadConfiguration() {
-  Serial.println("load");
-  #ifdef AVR
-    EEPROM.get(configAddr, configuration);
-  #endif 
-  #ifdef ESP32
-    const int lCLen = prefs.getBytesLength("lC");
-    Serial.printf("lCLen = %d\n", lCLen);
-    prefs.getBytes("lC", buff, lCLen);
-    configuration = (ledsConfig *) buff;
-  #endif
+bool loadConfiguration() {
+  if (!configStore.load(&presets)) return false;
+  presets.unpack(presets.getActive(), configuration);
+  return true;
 }
 
 /**
  * save LED config to EEPROM
  */
 void saveConfiguration() {
-  Serial.println("save");
-  #ifdef AVR
-    EEPROM.put(configAddr, configuration);
-  #endif 
-  #ifdef ESP32
-    prefs.putBytes("lC", configuration, sizeof(ledsConfig));
-  #endif
+  STAGE_TIMER_BEGIN(saveTimer);
+  LOG_DEBUG(eventLog, F("save"));
+  presets.pack(presets.getActive(), configuration);
+  configStore.save(&presets);
+  STAGE_TIMER_END(saveTimer);
 }
 
 void activateAutoSave() {
@@ -275,21 +428,61 @@ void activateAutoSave() {
 void checkAutoSaveToEEPROM() {
   if (millis() - lastTimeConfigChanged > AUTOSAVE_DELAY && configChanged) {
     configChanged = false;
-    Serial.println("autosave");
+    LOG_INFO(eventLog, F("autosave"));
     saveConfiguration();
   }
 }
 
+// brightness level the light sensor asks for, AMBIENT_NONE until it has or after one set by hand
+const byte AMBIENT_NONE = 0xFF;
+byte ambientBrightness = AMBIENT_NONE;
+
+/**
+ * brightness level asked for, by the light sensor while autoBrightness is on
+ * or else the configured one, before the battery cap
+ */
+byte requestedBrightness() {
+  if (configuration.autoBrightness && ambientBrightness != AMBIENT_NONE) return ambientBrightness;
+  return configuration.curBrightness;
+}
+
+/**
+ * take a brightness level set by hand, over the light sensor's
+ */
+void setBrightness(byte level) {
+  configuration.curBrightness = level;
+  ambientBrightness = AMBIENT_NONE;
+}
+
+/**
+ * follow the light sensor while autoBrightness is on.
+ * the level is kept apart from curBrightness, so riding past streetlights
+ * neither activates the autosave nor ends up in the next save. a brightness
+ * set by hand holds until the ambient level changes.
+ */
+void applyAutoBrightness() {
+  if (!configuration.autoBrightness || !lightSensor.ready()) return;
+  ambientBrightness = pgm_read_byte(&LDR_BRIGHTNESS[lightSensor.getLevel()]);
+}
+
+/**
+ * keep the active preset's changes in the bank and unpack another one
+ */
+void selectPreset(uint8_t preset) {
+  presets.pack(presets.getActive(), configuration);
+  presets.setActive(preset);
+  presets.unpack(preset, configuration);
+  applyAutoBrightness();
+}
+
 /**
  * single click - switch brightness between off, low, med, and high
  */
 void btn1_1shortclick_func() {
   activateAutoSave();
-  configuration->curBrightness++;
-  // Serial.println(configuration->curBrightness > PWR_HIGH);
-  if (configuration->curBrightness > PWR_HIGH) configuration->curBrightness = PWR_OFF;
-  Serial.print("curBrightness = ");
-  Serial.println(configuration->curBrightness);
+  byte level = requestedBrightness() + 1;
+  setBrightness(level > PWR_HIGH ? (byte) PWR_OFF : level);
+  LOG_INFO(eventLog, F("curBrightness = %"), configuration.curBrightness);
 }
 
 /**
@@ -297,10 +490,19 @@ void btn1_1shortclick_func() {
  */
 void btn1_2shortclicks_func() {
   activateAutoSave();
-  configuration->curMode++;
-  if (configuration->curMode > MODE_NORMPLUSRGB) configuration->curMode = 0;
-  Serial.print("curMode = ");
-  Serial.println(configuration->curMode);
+  configuration.curMode++;
+  if (configuration.curMode > MODE_NORMPLUSRGB) configuration.curMode = 0;
+  LOG_INFO(eventLog, F("curMode = %"), configuration.curMode);
+}
+
+/**
+ * triple click - switch to the next preset
+ */
+void btn1_3shortclicks_func() {
+  activateAutoSave();
+  uint8_t preset = presets.getActive();
+  selectPreset(preset + 1 < NUM_PRESETS ? preset + 1 : 0);
+  LOG_INFO(eventLog, F("preset = %"), presets.getActive());
 }
 
 /**
@@ -308,11 +510,10 @@ void btn1_2shortclicks_func() {
  */
 void btn1_1longpress_func() {
   activateAutoSave();
-  configuration->lenColors = 1;
-  configuration->curColors[0]++;
-  if (configuration->curColors[0] > WHITE_HUE_INDEX) configuration->curColors[0] = 0;
-  Serial.print("configuration->curColors[0] = ");
-  Serial.println(configuration->curColors[0]);
+  configuration.lenColors = 1;
+  configuration.curColors[0]++;
+  if (configuration.curColors[0] > WHITE_HUE_INDEX) configuration.curColors[0] = 0;
+  LOG_INFO(eventLog, F("configuration->curColors[0] = %"), configuration.curColors[0]);
 }
 
 /**
@@ -320,328 +521,766 @@ void btn1_1longpress_func() {
  */
 void btn1_2longpress_func() {
   activateAutoSave();
-  configuration->curRGBMode++;
-  if (configuration->curRGBMode > 6) configuration->curRGBMode = 0;
-  Serial.print("configuration->curRGBMode = ");
-  Serial.println(configuration->curRGBMode);
+  configuration.curRGBMode++;
+  if (configuration.curRGBMode > 6) configuration.curRGBMode = 0;
+  LOG_INFO(eventLog, F("configuration->curRGBMode = %"), configuration.curRGBMode);
+}
+
+/**
+ * triple long press - switch automatic brightness on and off
+ */
+void btn1_3longpress_func() {
+  activateAutoSave();
+  // the lights stay at the level they were at until the sensor has one
+  setBrightness(requestedBrightness());
+  configuration.autoBrightness = !configuration.autoBrightness;
+  applyAutoBrightness();
+  LOG_INFO(eventLog, F("configuration->autoBrightness = %"), configuration.autoBrightness);
+}
+
+/**
+ * hand the configuration to the render task.
+ * the buttons, sensors and serial commands change configuration on the loop
+ * core, so with DUAL_CORE_RENDER it is copied over once per loop, whole.
+ */
+void publishConfig() {
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    portENTER_CRITICAL(&configLock);
+    sharedConfig = configuration;
+    sharedConfig.curBrightness = requestedBrightness();
+    portEXIT_CRITICAL(&configLock);
+  #endif
+}
+
+/**
+ * take the configuration a frame is rendered with, so a frame never sees half a change
+ */
+void takeConfig() {
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    portENTER_CRITICAL(&configLock);
+    renderConfig = sharedConfig;
+    portEXIT_CRITICAL(&configLock);
+  #else
+    renderConfig = configuration;
+    renderConfig.curBrightness = requestedBrightness();
+  #endif
+}
+
+/**
+ * brightness level the lights are rendered at, the requested one capped by the battery
+ */
+byte derateBrightness() {
+  byte cap = pgm_read_byte(&BATTERY_BRIGHTNESS_CAPS[battery.getStep()]);
+  return renderConfig.curBrightness < cap ? renderConfig.curBrightness : cap;
 }
 
 /**
  * control front white and rear red LEDs
+ * they are only re-rendered when the brightness changes
  */
 void controlfrLEDs() {
-  for (int i=0;i<NUM_LEDS/2;i++) {
-    frontLeds[i] = CHSV(WHITE_HUE, WHITE_SATURATION, BRIGHTNESS_VALUES[configuration->curBrightness]);
-  }
+  byte level = derateBrightness();
+  byte step = battery.getStep();
+  if (level == frLEDsLevel && step == frLEDsStep && !rerenderLEDs) return;
+  frLEDsLevel = level;
+  frLEDsStep = step;
+  // on the reserve, only the rear light stays on
+  byte frontLevel = step == BATTERY_RESERVE_STEP ? (byte) PWR_OFF : level;
+  fillSegment(segments[SEGMENT_FRONT], CHSV(WHITE_HUE, WHITE_SATURATION, pgm_read_byte(&BRIGHTNESS_VALUES[frontLevel])));
+  fillSegment(segments[SEGMENT_REAR], CHSV(RED_HUE, RED_SATURATION, pgm_read_byte(&BRIGHTNESS_VALUES[level])));
 }
 
 /**
  * turn off RGB LEDs
  */
 void offLEDs() {
-  for (int i=0;i<NUM_LEDS/2;i++) {
-    rgbLeds[i] = CHSV(0, 0, 0);
+  if (rgbLEDsOff) return;
+  rgbLEDsOff = true;
+  fillSegment(segments[SEGMENT_SIDE], CRGB(0, 0, 0));
+}
+
+/**
+ * animate RGB LEDs in the current RGB mode
+ */
+void rgbModeLEDs() {
+  byte rgbMode = renderConfig.curRGBMode > RGBMODE_REVERSESHIFT? (byte) RGBMODE_CONSTANT : renderConfig.curRGBMode;
+  rgbAnimation.setMode(&RGB_MODES[rgbMode]);
+  rgbPalette.update(renderConfig.curColors, renderConfig.lenColors,
+      pgm_read_byte(&BRIGHTNESS_VALUES[derateBrightness()]));
+  bool stepped = rgbAnimation.update(rgbPalette.getColors(), rgbPalette.getNumColors());
+  if (stepped || rerenderLEDs) {
+    rgbAnimation.render(segments[SEGMENT_SIDE].leds, segments[SEGMENT_SIDE].numLeds);
+    rgbAnimation.getChannelSums(segments[SEGMENT_SIDE].numLeds, segments[SEGMENT_SIDE].channelSums);
+    segments[SEGMENT_SIDE].rendered = true;
+    rgbLEDsOff = false;
   }
 }
 
 /**
- * constant on RGB LEDs
+ * scale the re-rendered segments down to the current budget.
+ * the estimate comes from the segments' channel sums, so only pixels that
+ * changed were looked at to get it.
+ */
+void limitPower() {
+  rerenderLEDs = powerLimiter.update(segments, NUM_SEGMENTS, 1 << SEGMENT_SIDE);
+  for (int i=0;i<NUM_SEGMENTS;i++) powerLimiter.apply(segments[i], i);
+}
+
+/**
+ * number of LEDs driven by a FastLED controller
  */
-void constantLEDs() {
-  curSaturationVal = configuration->curColors[0] == WHITE_HUE_INDEX? 0 : 255;
-  curHueVal = HUE_VALUES[configuration->curColors[0]];
-  curBrightnessVal = BRIGHTNESS_VALUES[configuration->curBrightness];
-  for (int i=0;i<NUM_LEDS/2;i++) {
-    rgbLeds[i] = CHSV(curHueVal, curSaturationVal, curBrightnessVal);
+int controllerLength(uint8_t controller) {
+  int len = 0;
+  for (int i=0;i<NUM_SEGMENTS;i++) {
+    if (segments[i].controller == controller) len += segments[i].numLeds;
   }
+  return len;
+}
+
+/**
+ * one FastLED controller per data pin, each driving its segment and the
+ * segments chained after it
+ */
+void addLEDControllers() {
+  FastLED.addLeds<LED_TYPE, LED_PIN, COLOR_ORDER>(leds, controllerLength(0)).setCorrection( TypicalLEDStrip );
+  #ifdef SIDE_LED_PIN
+    FastLED.addLeds<LED_TYPE, SIDE_LED_PIN, COLOR_ORDER>(segments[SEGMENT_SIDE].leds, controllerLength(SIDE_CONTROLLER)).setCorrection( TypicalLEDStrip );
+  #endif
+  #ifdef REAR_LED_PIN
+    FastLED.addLeds<LED_TYPE, REAR_LED_PIN, COLOR_ORDER>(segments[SEGMENT_REAR].leds, controllerLength(REAR_CONTROLLER)).setCorrection( TypicalLEDStrip );
+  #endif
+}
+
+/**
+ * time from the last wake-up to this frame being shown
+ */
+void recordWake() {
+  #ifdef STAGE_TIMING
+    if (!wakeTicks) return;
+    wakeTimer.record(StageTimer::now() - wakeTicks);
+    wakeTicks = 0;
+  #endif
 }
 
 /**
- * single flash RGB LEDs
- */
-void singleFlashLEDs() {
-  // 1 Hz, single 30% DC flash
-  updatePeriodinMillis = 100;
-  keyPoints[0] = 0;
-  keyPoints[1] = keyPoints[0] + 300/updatePeriodinMillis;
-  keyPoints[2] = totalPeriodLengthinMillis/updatePeriodinMillis;
-  if (millis() - flashCycleTimer >= updatePeriodinMillis) {
-    flashCycleTimer = millis();
-    if (ctr1 < keyPoints[1]) curBrightnessVal = BRIGHTNESS_VALUES[configuration->curBrightness];
-    else curBrightnessVal = 0;
-    curHueIndex = curHueIndex > configuration->lenColors-1? 0: curHueIndex;
-    curHueVal = HUE_VALUES[configuration->curColors[curHueIndex]];
-    curSaturationVal = configuration->curColors[curHueIndex] == WHITE_HUE_INDEX? 0 : 255;
-    if (ctr1 > keyPoints[2] - 1) {
-      curHueIndex++;
+ * push the changed segments out to the strips
+ */
+void showLEDs(uint8_t changedSegments) {
+  STAGE_TIMER_BEGIN(showTimer);
+  #ifdef ESP32
+    // all data pins go out in parallel, so a full show costs as much as the longest string
+    FastLED.show();
+  #else
+    // data pins go out one after another, so only send the strings that changed
+    uint8_t changedControllers = 0;
+    for (int i=0;i<NUM_SEGMENTS;i++) {
+      if (changedSegments & (1 << i)) changedControllers |= 1 << segments[i].controller;
     }
-    ctr1 = ctr1 > keyPoints[2] - 1? 0:ctr1 + 1;
-    for (int i=0;i<NUM_LEDS/2;i++) {
-      rgbLeds[i] = CHSV(curHueVal, curSaturationVal, curBrightnessVal);
+    for (int i=0;i<FastLED.count();i++) {
+      if (changedControllers & (1 << i)) FastLED[i].showLeds(FastLED.getBrightness());
     }
+  #endif
+  STAGE_TIMER_END(showTimer);
+  recordWake();
+}
+
+/**
+ * print and reset the frame scheduler counters for the current RGB mode
+ */
+void printFrameStats() {
+  #ifdef FRAME_STATS
+    unsigned long statsPeriod = millis() - lastFrameStatsTime;
+    if (statsPeriod < FRAME_STATS_INTERVAL) return;
+    lastFrameStatsTime = millis();
+    Serial.print(F("frames mode="));
+    Serial.print(renderConfig.curMode);
+    Serial.print(F(" rgbMode="));
+    Serial.print(renderConfig.curRGBMode);
+    Serial.print(F(" rendered="));
+    Serial.print(frameScheduler.getFramesRendered());
+    Serial.print(F(" pushed="));
+    Serial.print(frameScheduler.getFramesPushed());
+    Serial.print(F(" skipped="));
+    Serial.println(frameScheduler.getFramesSkipped());
+    frameScheduler.resetStats();
+    Serial.print(F("current mA="));
+    Serial.print(powerLimiter.getMilliamps());
+    Serial.print(F(" demand="));
+    Serial.print(powerLimiter.getDemandMilliamps());
+    Serial.print(F(" budget="));
+    Serial.println(powerLimiter.getBudget());
+    #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+      Serial.print(F("core busy render="));
+      Serial.print(renderBusyMicros / 10 / statsPeriod);
+      Serial.print(F("% output="));
+      Serial.print(outputBusyMicros / 10 / statsPeriod);
+      Serial.println(F("%"));
+      renderBusyMicros = 0;
+      outputBusyMicros = 0;
+    #endif
+  #endif
+}
+
+#if defined(ESP32) && defined(DUAL_CORE_RENDER)
+/**
+ * point each FastLED controller at its LEDs in a frame buffer
+ */
+void bindLEDControllers(CRGB* frame) {
+  uint8_t boundControllers = 0;
+  for (int i=0;i<NUM_SEGMENTS;i++) {
+    uint8_t controller = segments[i].controller;
+    if (boundControllers & (1 << controller)) continue;
+    boundControllers |= 1 << controller;
+    FastLED[controller].setLeds(frame + (segments[i].leds - leds), controllerLength(controller));
   }
 }
 
 /**
- * double flash RGB LEDs
- */
-void doubleFlashLEDs() {
-  // 1 Hz, double 15% DC flash
-  updatePeriodinMillis = 50;
-  keyPoints[0] = 0;
-  keyPoints[1] = keyPoints[0] + 150/updatePeriodinMillis;
-  keyPoints[2] = keyPoints[1] + 150/updatePeriodinMillis;
-  keyPoints[3] = keyPoints[2] + 150/updatePeriodinMillis;
-  keyPoints[4] = totalPeriodLengthinMillis/updatePeriodinMillis;
-  if (millis() - flashCycleTimer >= updatePeriodinMillis) {
-    flashCycleTimer = millis();
-    if ((ctr1 < keyPoints[1]) || (ctr1 >= keyPoints[2] && ctr1 < keyPoints[3])) curBrightnessVal = BRIGHTNESS_VALUES[configuration->curBrightness];
-    else curBrightnessVal = 0;
-    curHueIndex = curHueIndex > configuration->lenColors-1? 0: curHueIndex;
-    curHueVal = HUE_VALUES[configuration->curColors[curHueIndex]];
-    curSaturationVal = configuration->curColors[curHueIndex] == WHITE_HUE_INDEX? 0 : 255;
-    if (ctr1 > keyPoints[4] - 1) {
-      curHueIndex++;
-    }
-    ctr1 = ctr1 > keyPoints[4] - 1? 0:ctr1 + 1;
-    for (int i=0;i<NUM_LEDS/2;i++) {
-      rgbLeds[i] = CHSV(curHueVal, curSaturationVal, curBrightnessVal);
-    }
+ * hand a changed frame from the render task to the output loop
+ */
+void publishFrame(uint8_t changedSegments) {
+  memcpy(frameBuffers[frameExchange.backIndex()], leds, sizeof(leds));
+  frameExchange.publish();
+}
+
+/**
+ * show the latest frame published by the render task.
+ * returns true if a frame was shown.
+ */
+bool outputFrame() {
+  // a frame published before the render task parked would cover the stream
+  if (streaming || !frameExchange.takeFresh()) return false;
+  bindLEDControllers(frameBuffers[frameExchange.frontIndex()]);
+  STAGE_TIMER_BEGIN(showTimer);
+  FastLED.show();
+  STAGE_TIMER_END(showTimer);
+  recordWake();
+  return true;
+}
+
+#endif
+
+/**
+ * LED control loop for all LEDs
+ * renders one frame per frame period and only pushes frames that changed.
+ * returns true if a frame was rendered.
+ */
+bool ledLoop() {
+  if (streaming || !frameScheduler.frameDue()) return false;
+  STAGE_TIMER_BEGIN(ledLoopTimer);
+  takeConfig();
+  controlfrLEDs();
+  if (renderConfig.curMode == MODE_NORMPLUSRGB && renderConfig.curBrightness != PWR_OFF
+      && battery.getStep() != BATTERY_RESERVE_STEP) {
+    rgbModeLEDs();
+  } else {
+    offLEDs();
   }
+  limitPower();
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    frameScheduler.present(segments, NUM_SEGMENTS, publishFrame);
+  #else
+    frameScheduler.present(segments, NUM_SEGMENTS, showLEDs);
+  #endif
+  STAGE_TIMER_END(ledLoopTimer);
+  printFrameStats();
+  return true;
 }
 
 /**
- * single fade RGB LEDs
- */
-void singleFadeLEDs() {
-  updatePeriodinMillis = 5;
-  keyPoints[0] = 0;
-  keyPoints[1] = keyPoints[0] + 400/updatePeriodinMillis;
-  keyPoints[2] = keyPoints[1] + 400/updatePeriodinMillis;
-  keyPoints[3] = keyPoints[2] + 200/updatePeriodinMillis;
-  // 1 Hz fade; 400 mS rise, 400 mS fall, 200 mS off
-  // 5 ms fading steps
-  // 200 total steps; 0,80,160,200
-  if (millis() - flashCycleTimer >= updatePeriodinMillis) {
-    flashCycleTimer = millis();
-    if (ctr1 < keyPoints[1]) {
-      curBrightnessVal = sin8((ctr1-keyPoints[0])*64/(keyPoints[1] - keyPoints[0])) * BRIGHTNESS_VALUES[configuration->curBrightness] / 255;
-    } 
-    else if (ctr1 >= keyPoints[1] && ctr1 < keyPoints[2]) {
-      curBrightnessVal = sin8((ctr1-keyPoints[1])*64/(keyPoints[2] - keyPoints[1])+64) * BRIGHTNESS_VALUES[configuration->curBrightness] / 255;
-    } 
-    else if (ctr1 >= keyPoints[2]) {
-      curBrightnessVal = 0;
-    }
-    curHueIndex = curHueIndex > configuration->lenColors-1? 0: curHueIndex;
-    curHueVal = HUE_VALUES[configuration->curColors[curHueIndex]];
-    curSaturationVal = configuration->curColors[curHueIndex] == WHITE_HUE_INDEX? 0 : 255;
-    if (ctr1 > keyPoints[3] - 1) {
-      curHueIndex++;
-    }
-    ctr1 = ctr1 > keyPoints[3] - 1? 0:ctr1 + 1;
-    for (int i=0;i<NUM_LEDS/2;i++) {
-      rgbLeds[i] = CHSV(curHueVal, curSaturationVal, curBrightnessVal);
-    }
+ * write queued log lines into the free space of the serial transmit buffer,
+ * so the loop doesn't wait for the UART. lines that don't fit yet stay queued.
+ */
+void drainLog() {
+  #if LOG_LEVEL > LOG_LEVEL_NONE
+    eventLog.drain(Serial.availableForWrite(), writeSerial);
+  #endif
+}
+
+/**
+ * true while a host is talking to the control protocol, see CONTROL_LINK_TIME
+ */
+bool controlLinkUp() {
+  if (controlLink && millis() - lastControlTime >= CONTROL_LINK_TIME) controlLink = false;
+  return controlLink;
+}
+
+/**
+ * sleep while the lights are off and no host is in control, until btn1 is pressed.
+ * the black frame is shown, the log written out and any pending config
+ * change saved first; millis() doesn't run in AVR power-down, so the autosave
+ * wouldn't come.
+ */
+void sleepWhileOff() {
+  if (requestedBrightness() != PWR_OFF || frLEDsLevel != PWR_OFF || !rgbLEDsOff) return;
+  if (!btn1.idle() || streaming || controlLinkUp()) return;
+  #if LOG_LEVEL > LOG_LEVEL_NONE
+    if (!eventLog.empty()) return;
+  #endif
+  // lights turned off by daylight stay awake to come back on at dusk
+  if (configuration.autoBrightness && pgm_read_byte(&LDR_BRIGHTNESS[lightSensor.getLevel()]) == PWR_OFF) return;
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    // let the render task finish the frame it may be working on, and show it if it changed
+    vTaskDelay(pdMS_TO_TICKS(2000 / UPDATES_PER_SECOND) + 1);
+    if (outputFrame()) return;
+  #endif
+  if (configChanged) {
+    configChanged = false;
+    saveConfiguration();
   }
+  Serial.flush();
+  adcSampler.end();
+  #ifdef LED_POWER_PIN
+    digitalWrite(LED_POWER_PIN, LOW);
+  #endif
+  sleepUntilLow(BTN1_PIN, btn1_change_func);
+  #ifdef LED_POWER_PIN
+    digitalWrite(LED_POWER_PIN, HIGH);
+  #endif
+  adcSampler.begin();
+  #ifdef STAGE_TIMING
+    wakeTicks = StageTimer::now();
+  #endif
+  // the strip may have lost power, so show the next frame even if it didn't change
+  frameScheduler.invalidate();
 }
 
 /**
- * double fade RGB LEDs
- */
-void doubleFadeLEDs() {
-  updatePeriodinMillis = 5;
-  keyPoints[0] = 0;
-  keyPoints[1] = keyPoints[0] + 200/updatePeriodinMillis;
-  keyPoints[2] = keyPoints[1] + 200/updatePeriodinMillis;
-  keyPoints[3] = keyPoints[2] + 200/updatePeriodinMillis;
-  keyPoints[4] = keyPoints[3] + 200/updatePeriodinMillis;
-  keyPoints[5] = keyPoints[4] + 200/updatePeriodinMillis;
-  // 1 Hz double fade; 200 mS rise, 200 mS fall, 200 mS off
-  // 5 ms fading steps
-  // 200 total steps; 0,40,80,120,160,200
-  if (millis() - flashCycleTimer >= updatePeriodinMillis) {
-    flashCycleTimer = millis();
-    if (ctr1 < keyPoints[1]) {
-      curBrightnessVal = sin8((ctr1-keyPoints[0])*64/(keyPoints[1] - keyPoints[0])) * BRIGHTNESS_VALUES[configuration->curBrightness] / 255;
-    }
-    else if (ctr1 >= keyPoints[1] && ctr1 < keyPoints[2]) {
-      curBrightnessVal = sin8((ctr1-keyPoints[1])*64/(keyPoints[2] - keyPoints[1])+64) * BRIGHTNESS_VALUES[configuration->curBrightness] / 255;
-    } 
-    if (ctr1 >= keyPoints[2] && ctr1 < keyPoints[3]) {
-      curBrightnessVal = sin8((ctr1-keyPoints[2])*64/(keyPoints[3] - keyPoints[2])) * BRIGHTNESS_VALUES[configuration->curBrightness] / 255;
-    } 
-    else if (ctr1 >= keyPoints[3] && ctr1 < keyPoints[4]) {
-      curBrightnessVal = sin8((ctr1-keyPoints[3])*64/(keyPoints[4] - keyPoints[3])+64) * BRIGHTNESS_VALUES[configuration->curBrightness] / 255;
-    } 
-    else if (ctr1 >= keyPoints[4]) {
-      curBrightnessVal = 0;
-    }
-    curHueIndex = curHueIndex > configuration->lenColors-1? 0: curHueIndex;
-    curHueVal = HUE_VALUES[configuration->curColors[curHueIndex]];
-    curSaturationVal = configuration->curColors[curHueIndex] == WHITE_HUE_INDEX? 0 : 255;
-    if (ctr1 > keyPoints[5] - 1) {
-      curHueIndex++;
-    }
-    ctr1 = ctr1 > keyPoints[5] - 1? 0:ctr1 + 1;
-    for (int i=0;i<NUM_LEDS/2;i++) {
-      rgbLeds[i] = CHSV(curHueVal, curSaturationVal, curBrightnessVal);
-    }
+ * derate the lights as the pack empties.
+ * the lights pick the new step up on their next frame.
+ */
+void checkBattery() {
+  if (!battery.update()) return;
+  LOG_WARN(eventLog, F("battery mV=% step=%"), battery.getMillivolts(), battery.getStep());
+}
+
+/**
+ * follow the ambient light level
+ */
+void checkLightSensor() {
+  if (!lightSensor.update()) return;
+  LOG_INFO(eventLog, F("ambient level=% reading=%"), lightSensor.getLevel(), lightSensor.getReading());
+  applyAutoBrightness();
+}
+
+/**
+ * fold in the background ADC samples and act on them.
+ * most calls only compare millis(), the sensors are looked at every 100 ms or more.
+ */
+void checkSensors() {
+  STAGE_TIMER_BEGIN(sensorTimer);
+  adcSampler.poll();
+  checkBattery();
+  checkLightSensor();
+  STAGE_TIMER_END(sensorTimer);
+}
+
+#ifdef STAGE_TIMING
+/**
+ * print and reset the stage timing stats
+ */
+void printStageTimers() {
+  // the ledLoop stage includes show, except with DUAL_CORE_RENDER
+  ledLoopTimer.print(F("ledLoop"));
+  showTimer.print(F("show"));
+  buttonTimer.print(F("button"));
+  saveTimer.print(F("save"));
+  sensorTimer.print(F("sensor"));
+  loopIntervalTimer.print(F("loopInterval"));
+  wakeTimer.print(F("wake"));
+  ledLoopTimer.reset();
+  showTimer.reset();
+  buttonTimer.reset();
+  saveTimer.reset();
+  sensorTimer.reset();
+  loopIntervalTimer.reset();
+  wakeTimer.reset();
+}
+#endif
+
+/**
+ * true if a CMD_SET field has a valid length and value
+ */
+bool validField(const ProtocolField& field) {
+  switch (field.id) {
+    case FIELD_POWER:
+      return field.len == 1 && field.value[0] <= PWR_HIGH;
+    case FIELD_MODE:
+      return field.len == 1 && field.value[0] <= MODE_NORMPLUSRGB;
+    case FIELD_RGBMODE:
+      return field.len == 1 && field.value[0] <= RGBMODE_REVERSESHIFT;
+    case FIELD_PALETTE:
+      if (field.len < 1 || field.len > MAX_PRESET_COLORS) return false;
+      for (int i=0;i<field.len;i++) {
+        if (field.value[i] > BLACK_HUE_INDEX) return false;
+      }
+      return true;
+    case FIELD_PRESET:
+      return field.len == 1 && field.value[0] < NUM_PRESETS;
+    case FIELD_AUTO:
+      return field.len == 1 && field.value[0] <= 1;
+    default:
+      return false;
+  }
+}
+
+void applyField(const ProtocolField& field) {
+  switch (field.id) {
+    case FIELD_POWER:
+      setBrightness(field.value[0]);
+      break;
+    case FIELD_MODE:
+      configuration.curMode = field.value[0];
+      break;
+    case FIELD_RGBMODE:
+      configuration.curRGBMode = field.value[0];
+      break;
+    case FIELD_PALETTE:
+      memcpy(configuration.curColors, field.value, field.len);
+      configuration.lenColors = field.len;
+      break;
+    case FIELD_PRESET:
+      selectPreset(field.value[0]);
+      break;
+    case FIELD_AUTO:
+      configuration.autoBrightness = field.value[0];
+      applyAutoBrightness();
+      break;
   }
 }
 
 /**
- * shift forward/backward RGB LEDs 
+ * add a field of the current config to a response
  */
-void shiftLEDs(bool forward=true) {
-  // left/right shift multiple colors throughout the LED array
-  /**
-   * shift the LED pixels every 100 ms
-   * 4 pixels red, 4 pixels green, 4 pixels blue 
-  */ 
-  updatePeriodinMillis = 100;
-  keyPoints[0] = 0;
-  for (int i=0;i<3;i++) {
-    keyPoints[i+1] = keyPoints[i] + 400/updatePeriodinMillis;
+void addConfigField(ProtocolCodec& codec, uint8_t id) {
+  switch (id) {
+    case FIELD_VERSION:
+      codec.addField(id, PROTOCOL_VERSION);
+      break;
+    case FIELD_POWER:
+      codec.addField(id, requestedBrightness());
+      break;
+    case FIELD_MODE:
+      codec.addField(id, configuration.curMode);
+      break;
+    case FIELD_RGBMODE:
+      codec.addField(id, configuration.curRGBMode);
+      break;
+    case FIELD_PALETTE:
+      codec.addField(id, configuration.curColors, configuration.lenColors);
+      break;
+    case FIELD_PRESET:
+      codec.addField(id, presets.getActive());
+      break;
+    case FIELD_AUTO:
+      codec.addField(id, configuration.autoBrightness);
+      break;
   }
-  
-  if (millis() - flashCycleTimer >= updatePeriodinMillis) {
-    flashCycleTimer = millis();
-    ctr1++;
-    if (!(ctr1 % 4)) {
-      curHueIndex++;
+}
+
+/**
+ * answer a received control frame, from any transport
+ */
+void handleCommand(ProtocolCodec& codec) {
+  ProtocolField field;
+  lastControlTime = millis();
+  controlLink = true;
+  if (codec.getVersion() != PROTOCOL_VERSION) {
+    codec.beginResponse(STATUS_BAD_VERSION);
+    codec.addField(FIELD_VERSION, PROTOCOL_VERSION);
+    codec.endFrame();
+    return;
+  }
+  switch (codec.getCommand()) {
+    case CMD_PING:
+      codec.beginResponse(STATUS_OK);
+      codec.addField(FIELD_VERSION, PROTOCOL_VERSION);
+      break;
+    case CMD_GET: {
+      codec.beginResponse(STATUS_OK);
+      bool named = false;
+      while (codec.nextField(field)) {
+        named = true;
+        addConfigField(codec, field.id);
+      }
+      for (uint8_t id=FIELD_VERSION;!named && id<NUM_FIELDS;id++) addConfigField(codec, id);
+      break;
     }
-    // chase single colors with black
-    if (configuration->lenColors <= 1 ) {
-      configuration->curColors[1] = BLACK_HUE_INDEX;
-      curHueIndex = curHueIndex > 1 ?0: curHueIndex;
+    case CMD_SET: {
+      // all or nothing: check every field before applying any
+      uint8_t status = STATUS_OK;
+      while (status == STATUS_OK && codec.nextField(field)) {
+        if (field.id == FIELD_STATUS || field.id == FIELD_VERSION || field.id >= NUM_FIELDS) status = STATUS_BAD_FIELD;
+        else if (!validField(field)) status = STATUS_BAD_VALUE;
+      }
+      if (status == STATUS_OK) {
+        codec.rewindFields();
+        while (codec.nextField(field)) applyField(field);
+        activateAutoSave();
+      }
+      codec.beginResponse(status);
+      break;
     }
-    else {
-      curHueIndex = curHueIndex > (configuration->lenColors - 1)?0: curHueIndex;
+    default:
+      codec.beginResponse(STATUS_BAD_COMMAND);
+  }
+  codec.endFrame();
+}
+
+/**
+ * show a streamed frame as it is in the frame buffer.
+ * it still goes through the power limiter, which needs its channel sums.
+ * the frame is counted as late if the next one came in while it was shown;
+ * the host sends faster than the strip takes frames, and the next frame may
+ * have lost bytes to a full serial buffer.
+ */
+void showStreamFrame() {
+  for (int i=0;i<NUM_SEGMENTS;i++) {
+    sumSegment(segments[i]);
+    segments[i].rendered = true;
+  }
+  limitPower();
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    // the render task is parked while streaming, so show the frame buffer itself
+    bindLEDControllers(leds);
+    STAGE_TIMER_BEGIN(showTimer);
+    FastLED.show();
+    STAGE_TIMER_END(showTimer);
+  #else
+    showLEDs((1 << NUM_SEGMENTS) - 1);
+  #endif
+  for (int i=0;i<NUM_SEGMENTS;i++) segments[i].rendered = false;
+  if (Serial.available() > STREAM_HEADER_SIZE) frameStream.markLate();
+}
+
+/**
+ * stop the rendered lights for a stream.
+ * with DUAL_CORE_RENDER the render task is asked to park, and this waits
+ * until it has, at most a frame, so the loop has the frame buffer, the
+ * segments and the power limiter to itself until the stream ends. streaming
+ * and renderParked are written and read in sequentially consistent order:
+ * the task clears renderParked before it looks at streaming again, so either
+ * it sees the request or this sees it rendering.
+ */
+void startStreaming() {
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    if (streaming) return;
+    __atomic_store_n(&streaming, true, __ATOMIC_SEQ_CST);
+    while (!__atomic_load_n(&renderParked, __ATOMIC_SEQ_CST)) taskYIELD();
+  #else
+    streaming = true;
+  #endif
+}
+
+/**
+ * go back to the rendered lights once the host stopped streaming.
+ * streaming is cleared last, so a parked render task only comes back to the
+ * render state once it is handed back.
+ */
+void checkStreamIdle() {
+  frameStream.checkTimeout();
+  if (!streaming || millis() - lastStreamTime < STREAM_IDLE_TIME) return;
+  LOG_INFO(eventLog, F("stream frames=% dropped=% late=%"), frameStream.getFramesReceived(),
+    frameStream.getFramesDropped(), frameStream.getFramesLate());
+  frameStream.resetStats();
+  rerenderLEDs = true;
+  rgbLEDsOff = false;
+  frameScheduler.invalidate();
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    __atomic_store_n(&streaming, false, __ATOMIC_SEQ_CST);
+  #else
+    streaming = false;
+  #endif
+}
+
+/**
+ * serial input: control frames start with PROTOCOL_SYNC, streamed frames with
+ * 'A', other bytes are text commands
+ *    t - print and reset the stage timing stats
+ * the pixels of a streamed frame are read straight into the frame buffer
+ */
+void checkSerialCommands() {
+  if (serialCodec.checkTimeout()) handleCommand(serialCodec);
+  checkStreamIdle();
+  while (Serial.available()) {
+    uint16_t len;
+    uint8_t* pixels = frameStream.pixelSpace(len);
+    if (pixels) {
+      // a valid header came in; a show of the rendered lights would hold up the serial input, so stop them
+      startStreaming();
+      lastStreamTime = millis();
+      int available = Serial.available();
+      if (len > available) len = available;
+      frameStream.commitPixels(Serial.readBytes(pixels, len));
+      continue;
     }
-    curHueVal = HUE_VALUES[configuration->curColors[curHueIndex]];
-    if (configuration->curColors[curHueIndex] == BLACK_HUE_INDEX) {
-      curBrightnessVal = 0;
+    uint8_t c = Serial.read();
+    if (serialCodec.receiving()) {
+      if (serialCodec.feed(c)) handleCommand(serialCodec);
     }
-    else if (configuration->curColors[curHueIndex] == WHITE_HUE_INDEX) {
-      curBrightnessVal = BRIGHTNESS_VALUES[configuration->curBrightness];
-      curSaturationVal = 0;
+    else if (frameStream.receiving() || c == 'A') {
+      if (frameStream.feed(c)) showStreamFrame();
     }
-    else {
-      curBrightnessVal = BRIGHTNESS_VALUES[configuration->curBrightness];
-      curSaturationVal = 255;
+    else if (c == PROTOCOL_SYNC) {
+      if (serialCodec.feed(c)) handleCommand(serialCodec);
     }
+    #ifdef STAGE_TIMING
+      else if (c == 't') printStageTimers();
+    #endif
+  }
+}
 
-    if (forward) {
-      // shift LEDs with the flow of data
-      for (int i=NUM_LEDS/2 - 1;i>0;i--) {
-        rgbLeds[i] = rgbLeds[i-1];
-      }
-      rgbLeds[0] = CHSV(curHueVal, curSaturationVal, curBrightnessVal);
-    } 
-    else {
-      // shift LEDs against the flow of data
-      for (int i=0;i<NUM_LEDS/2 - 1;i++) {
-        rgbLeds[i] = rgbLeds[i+1];
-      }
-      rgbLeds[NUM_LEDS/2 - 1] = CHSV(curHueVal, curSaturationVal, curBrightnessVal);
+#if defined(ESP32) && defined(DUAL_CORE_RENDER)
+/**
+ * render task, paced by the frame scheduler.
+ * parks while streaming, see startStreaming()
+ */
+void renderTask(void* parameter) {
+  for (;;) {
+    if (__atomic_load_n(&streaming, __ATOMIC_SEQ_CST)) {
+      __atomic_store_n(&renderParked, true, __ATOMIC_SEQ_CST);
+      vTaskDelay(1);
+      continue;
     }
+    __atomic_store_n(&renderParked, false, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&streaming, __ATOMIC_SEQ_CST)) continue;
+    unsigned long start = micros();
+    bool rendered = ledLoop();
+    renderBusyMicros += micros() - start;
+    if (!rendered) vTaskDelay(1);
   }
 }
+#endif
 
 /**
- * LED control loop for all LEDs
+ * config for a fresh device, or when no intact config could be loaded
  */
-void ledLoop() {
-  controlfrLEDs();
-  if (configuration->curMode == MODE_NORMPLUSRGB) {
-    switch (configuration->curRGBMode) {
-      case RGBMODE_SINGLEFLASH:
-        singleFlashLEDs();
-        break;
-      case RGBMODE_DOUBLEFLASH:
-        doubleFlashLEDs();
-        break;
-      case RGBMODE_SINGLEFADE:
-        singleFadeLEDs();
-        break;
-      case RGBMODE_DOUBLEFADE:
-        doubleFadeLEDs();
-        break;
-      case RGBMODE_FORWARDSHIFT:
-        shiftLEDs(true);
-        break;
-      case RGBMODE_REVERSESHIFT:
-        shiftLEDs(false);
-        break;
-      default:
-        constantLEDs();
-    }
-  } else {
-    offLEDs();
+void defaultConfiguration() {
+  // configuration.curColors[0] = 0;
+  // configuration.curColors[1] = 1;
+  // configuration.curColors[2] = 2;
+  // configuration.curColors[3] = 4;
+  // configuration.curColors[4] = 7;
+  // configuration.curColors[5] = 8;
+  // configuration.curColors[6] = 10;
+  // configuration.lenColors = 7;
+
+  // configuration.curColors[0] = 0;
+  // configuration.curColors[1] = 7;
+  // configuration.lenColors = 2;
+  configuration.curColors[0] = 0;
+  configuration.lenColors = 1;
+  configuration.curMode = MODE_NORMPLUSRGB;
+  configuration.curRGBMode = RGBMODE_SINGLEFADE;
+  configuration.curBrightness = PWR_LOW;
+  configuration.autoBrightness = 0;
+  // the presets start out as the same fade in different colors
+  const byte presetColors[NUM_PRESETS] = {0, 1, 2, 4, 6, 7, 8, WHITE_HUE_INDEX};
+  for (uint8_t i=0;i<NUM_PRESETS;i++) {
+    configuration.curColors[0] = presetColors[i];
+    presets.pack(i, configuration);
   }
-  FastLED.show();
+  presets.setActive(0);
+  presets.unpack(0, configuration);
 }
 
 void setup() {
-  #ifdef ESP32
-    prefs.begin("lC");
+  /**
+   * first light: the front and rear lights come on in their last known state
+   * before anything else is set up. logging and the write of a repaired
+   * config wait until they are on.
+   */
+  #ifdef LED_POWER_PIN
+    pinMode(LED_POWER_PIN, OUTPUT);
+    digitalWrite(LED_POWER_PIN, HIGH);
   #endif
-  Serial.begin(115200);
-  Serial.println("RESET");
-  configuration = (ledsConfig *) buff;
+  configStore.begin("lC");
+  addLEDControllers();
+  FastLED.setBrightness(  BRIGHTNESS );
+  powerLimiter.setOutputScale(TypicalLEDStrip, BRIGHTNESS);
+  bool loaded = loadConfiguration();
+  if (!loaded) defaultConfiguration();
+  publishConfig();
+  takeConfig();
+  controlfrLEDs();
+  limitPower();
+  frameScheduler.present(segments, NUM_SEGMENTS, showLEDs);
+  firstLightMicros = micros();
+
+  Serial.begin(SERIAL_BAUD);
+  LOG_INFO(eventLog, F("RESET"));
+  LOG_INFO(eventLog, F("first light us=%"), firstLightMicros);
+  rgbAnimation.setShiftBuffer(rgbShiftRing, NUM_SIDE_LEDS);
   btn1.begin(btn1_change_func);
+  btn1.setTimings(DEBOUNCE_DELAY, BTN1_MULTICLICK_DURATION, LONGCLICK_DURATION);
   // single click - cycle between off, low, medium, and high
   btn1.set1ShortPressFunc(btn1_1shortclick_func);
   // double click - cycle between driving lights only and driving lights + RGB 
   btn1.set2ShortPressFunc(btn1_2shortclicks_func);
+  // triple click - cycle through the presets
+  btn1.set3ShortPressFunc(btn1_3shortclicks_func);
   // single long press - cycle through preset RGB solid colors
   btn1.set1LongPressFunc(btn1_1longpress_func);
   // double long press - between constant, single flash, double flash, single fade, and double fade
   btn1.set2LongPressFunc(btn1_2longpress_func);
+  // triple long press - switch automatic brightness on and off
+  btn1.set3LongPressFunc(btn1_3longpress_func);
+  battery.begin(BATTERY_TIME_CONSTANT);
+  battery.setSteps(BATTERY_STEP_MV, sizeof(BATTERY_STEP_MV) / sizeof(BATTERY_STEP_MV[0]), BATTERY_RECOVER_MV);
+  lightSensor.begin(LDR_TIME_CONSTANT);
+  lightSensor.setThresholds(LDR_THRESHOLDS, sizeof(LDR_THRESHOLDS) / sizeof(LDR_THRESHOLDS[0]), LDR_HYSTERESIS, LDR_HOLD_TIME);
+  adcSampler.begin();
   pinMode(LED_BUILTIN, OUTPUT);
-  FastLED.addLeds<LED_TYPE, LED_PIN, COLOR_ORDER>(leds, NUM_LEDS).setCorrection( TypicalLEDStrip );
-  FastLED.setBrightness(  BRIGHTNESS );
-  // printConfiguration();
-  loadConfiguration();
-  // printConfiguration();
-
  
   printConfiguration();
-  // check the checkByte in the config to see if the data is valid
-  Serial.print("cb=");
-  Serial.println(configuration->checkByte);
-  if (configuration->checkByte != 0x0F) {
-    configuration->checkByte = 0x0F;
-    // configuration->curColors[0] = 0;
-    // configuration->curColors[1] = 1;
-    // configuration->curColors[2] = 2;
-    // configuration->curColors[3] = 4;
-    // configuration->curColors[4] = 7;
-    // configuration->curColors[5] = 8;
-    // configuration->curColors[6] = 10;
-    // configuration->lenColors = 7;
-
-    // configuration->curColors[0] = 0;
-    // configuration->curColors[1] = 7;
-    // configuration->lenColors = 2;
-    configuration->curColors[0] = 0;
-    configuration->lenColors = 1;
-    configuration->curMode = MODE_NORMPLUSRGB;
-    configuration->curRGBMode = RGBMODE_SINGLEFADE;
-    configuration->curBrightness = PWR_LOW;
-
+  // every saved record carries a CRC, so only an intact config is loaded
+  LOG_INFO(eventLog, F("loaded=%"), loaded);
+  if (!loaded) {
     saveConfiguration();
     printConfiguration();
   }
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    // the loop runs on the core setup() runs on, so render on the other one
+    bindLEDControllers(frameBuffers[frameExchange.frontIndex()]);
+    xTaskCreatePinnedToCore(renderTask, "render", 4096, NULL, 1, &renderTaskHandle, xPortGetCoreID() ? 0 : 1);
+  #endif
 }
 
 void loop() {
   /**
    * button loop and LED loop
+   * with DUAL_CORE_RENDER, frames are rendered by renderTask and the loop only
+   * shows them, so a slow autosave or serial write doesn't hold up rendering
    */
-  btn1.loop();
-  ledLoop();
-  checkAutoSaveToEEPROM();
+  #if defined(ESP32) && defined(DUAL_CORE_RENDER)
+    unsigned long start = micros();
+    STAGE_TIMER_INTERVAL(loopIntervalTimer);
+    STAGE_TIMER_BEGIN(buttonTimer);
+    btn1.loop();
+    STAGE_TIMER_END(buttonTimer);
+    bool shown = outputFrame();
+    checkAutoSaveToEEPROM();
+    checkSensors();
+    checkSerialCommands();
+    publishConfig();
+    outputBusyMicros += micros() - start;
+    if (!shown) {
+      drainLog();
+      sleepWhileOff();
+      vTaskDelay(1);
+    }
+  #else
+    STAGE_TIMER_INTERVAL(loopIntervalTimer);
+    STAGE_TIMER_BEGIN(buttonTimer);
+    btn1.loop();
+    STAGE_TIMER_END(buttonTimer);
+    bool rendered = ledLoop();
+    checkAutoSaveToEEPROM();
+    checkSensors();
+    checkSerialCommands();
+    // the loop has slack when it didn't render a frame
+    if (!rendered) drainLog();
+    sleepWhileOff();
+  #endif
 }
 
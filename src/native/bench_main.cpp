@@ -0,0 +1,1324 @@
+/**
+ * Host benchmark runner for the native environment.
+ *
+ * Renders every RGB mode through the animation engine at several strip
+ * lengths and reports the time per rendered frame, plus a checksum of the
+ * frames rendered over the first seconds of each mode. The checksums are
+ * compared against GOLDEN_CHECKSUMS so optimisations can be shown not to
+ * change the output. It also times the palette conversion, counts the
+ * visual steps of the fade modes at a low brightness, checks the flash
+ * frequency with loop stalls injected, replays bounce traces through InterruptButton,
+ * times ButtonGroup with a growing number of buttons, checks the incremental
+ * current estimate against a full rescan, checks ConfigStore wear
+ * and torn-write recovery, and runs the firmware's setup()/loop() on simulated
+ * time, with the lights on and off, on a draining battery and with the light
+ * sensor setting the brightness, and plays the host end of the serial control
+ * protocol and of frame streaming against it, and of a 115200 baud serial
+ * link reading the deferred log.
+ *
+ * The benches that check something return their number of failed checks,
+ * and the runner exits with 1 if any failed, so it can gate a build.
+ *
+ * pio run -e native && .pio/build/native/program
+ */
+#include <Arduino.h>
+#include <chrono>
+#include <cmath>
+#include "FastLED.h"
+#include "animation.h"
+#include "buttonlib2.h"
+#include "rgbmodes.h"
+#include "configstore.h"
+#include "powerlimit.h"
+#include "adcsampler.h"
+#include "battery.h"
+#include "lightsensor.h"
+#include "presets.h"
+#include "protocol.h"
+#include "framestream.h"
+#include "eventlog.h"
+#include "EEPROM.h"
+
+void setup();
+void loop();
+CRGB paletteColor(byte colorIndex, byte brightnessVal);
+extern unsigned long firstLightMicros;
+extern AdcSampler adcSampler;
+extern BatteryMonitor battery;
+extern LedSegment segments[];
+extern LightSensor lightSensor;
+extern ledsConfig configuration;
+extern PresetBank presets;
+extern ConfigStore configStore;
+extern FrameStream frameStream;
+extern volatile bool streaming;
+byte requestedBrightness();
+extern EventLog eventLog;
+void printConfiguration();
+void checkSensors();
+void checkSerialCommands();
+
+static const int NUM_MODES = RGBMODE_REVERSESHIFT + 1;
+static const char* const MODE_NAMES[NUM_MODES] = {
+    "constant", "singleFlash", "doubleFlash", "singleFade", "doubleFade", "forwardShift", "reverseShift",
+};
+static const int NUM_STRIP_SIZES = 4;
+static const int STRIP_SIZES[NUM_STRIP_SIZES] = {4, 60, 150, 300};
+static const int MAX_STRIP_SIZE = 300;
+// frames per mode, 10 simulated seconds at the 200 fps frame rate
+static const int BENCH_FRAMES = 2000;
+static const unsigned long FRAME_MICROS = 5000;
+// red, green, blue
+static const uint8_t BENCH_COLORS[] = {0, 4, 7};
+// BRIGHTNESS_VALUES[PWR_HIGH]
+static const uint8_t BENCH_BRIGHTNESS = 250;
+
+/**
+ * checksums of the benchmark frames, [mode][strip size]
+ * regenerate by running with an empty table and pasting the printed values
+ */
+static const uint32_t GOLDEN_CHECKSUMS[NUM_MODES][NUM_STRIP_SIZES] = {
+    {0xdca1d2c5, 0xb9bdb8c5, 0xdcfd0a45, 0x511024c5},
+    {0x4a5942c5, 0xaf5826c5, 0x362c1f45, 0x67c3b4c5},
+    {0x0bc15ac5, 0xf208aec5, 0x4d158545, 0x1e4a9ac5},
+    {0x07c51c9d, 0x17c85b1d, 0xb94b700d, 0x4bfe6c9d},
+    {0xfe5c31b1, 0x07f057e9, 0x83862fbb, 0x039ab879},
+    {0x4a3b6d85, 0x52d19d45, 0x737b0005, 0x601b2385},
+    {0xeedd6e05, 0xf6e0f845, 0x5530d885, 0xb30c6405},
+};
+
+static CRGB frame[MAX_STRIP_SIZE];
+static CRGB ring[MAX_STRIP_SIZE];
+
+static double nowNanos() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t hashBytes(uint32_t hash, const void* data, size_t len) {
+    const uint8_t* bytes = (const uint8_t*) data;
+    for (size_t i=0;i<len;i++) {
+        hash ^= bytes[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/**
+ * render BENCH_FRAMES frames of a mode, returns ns per frame and the checksum
+ */
+static double benchMode(int mode, int numLeds, uint32_t* checksum) {
+    AnimationEngine engine;
+    Palette palette(paletteColor);
+    engine.setShiftBuffer(ring, numLeds);
+    fill_solid(ring, numLeds, CRGB(0, 0, 0));
+    fill_solid(frame, numLeds, CRGB(0, 0, 0));
+    nativeSetMicros(0);
+    uint32_t hash = 2166136261UL;
+    double elapsed = 0;
+    for (int i=0;i<BENCH_FRAMES;i++) {
+        double start = nowNanos();
+        engine.setMode(&RGB_MODES[mode]);
+        palette.update(BENCH_COLORS, sizeof(BENCH_COLORS), BENCH_BRIGHTNESS);
+        if (engine.update(palette.getColors(), palette.getNumColors())) {
+            engine.render(frame, numLeds);
+        }
+        elapsed += nowNanos() - start;
+        hash = hashBytes(hash, frame, numLeds * sizeof(CRGB));
+        nativeAdvanceMicros(FRAME_MICROS);
+    }
+    *checksum = hash;
+    return elapsed / BENCH_FRAMES;
+}
+
+static int benchRender() {
+    int mismatches = 0;
+    bool haveGolden = GOLDEN_CHECKSUMS[0][0] != 0;
+    printf("render: ns per frame, checksum\n");
+    for (int mode=0;mode<NUM_MODES;mode++) {
+        printf("  %-13s", MODE_NAMES[mode]);
+        for (int s=0;s<NUM_STRIP_SIZES;s++) {
+            uint32_t checksum;
+            double ns = benchMode(mode, STRIP_SIZES[s], &checksum);
+            bool match = !haveGolden || checksum == GOLDEN_CHECKSUMS[mode][s];
+            if (!match) mismatches++;
+            printf(" %3d LEDs %7.1f ns 0x%08lx%s", STRIP_SIZES[s], ns, (unsigned long) checksum, match ? "" : " DIFF");
+        }
+        printf("\n");
+    }
+    if (!haveGolden) printf("  no golden checksums\n");
+    else printf("  golden checksums: %s\n", mismatches ? "DIFFERENT" : "match");
+    return mismatches;
+}
+
+/**
+ * one fading frame of the palette: the palette color of every LED converted
+ * from HSV and scaled, the color converted once per frame, dithered and
+ * filled in, as the engine did, and the color looked up in the cached palette
+ */
+enum PALETTEPATH {
+    PALETTE_PER_PIXEL = 0,
+    PALETTE_PER_FRAME,
+    PALETTE_CACHED,
+    NUM_PALETTE_PATHS,
+};
+
+static double benchPalettePath(int path, int numLeds, uint32_t* checksum) {
+    AnimationEngine engine;
+    Palette palette(paletteColor);
+    uint32_t hash = 2166136261UL;
+    double elapsed = 0;
+    for (int i=0;i<BENCH_FRAMES;i++) {
+        const uint8_t color = i / 64 % sizeof(BENCH_COLORS);
+        const uint16_t level = (i & 0xFF) * 257;
+        double start = nowNanos();
+        if (path == PALETTE_PER_PIXEL) {
+            for (int n=0;n<numLeds;n++) {
+                frame[n] = paletteColor(BENCH_COLORS[color], BENCH_BRIGHTNESS);
+                frame[n].nscale8_video(level >> 8);
+            }
+        }
+        else if (path == PALETTE_PER_FRAME) {
+            fill_solid(frame, numLeds, engine.dither(paletteColor(BENCH_COLORS[color], BENCH_BRIGHTNESS), level));
+        }
+        else {
+            palette.update(BENCH_COLORS, sizeof(BENCH_COLORS), BENCH_BRIGHTNESS);
+            fill_solid(frame, numLeds, engine.dither(palette.getColors()[color], level));
+        }
+        elapsed += nowNanos() - start;
+        hash = hashBytes(hash, frame, numLeds * sizeof(CRGB));
+    }
+    *checksum = hash;
+    return elapsed / BENCH_FRAMES;
+}
+
+static int benchPalette() {
+    static const char* const PATH_NAMES[NUM_PALETTE_PATHS] = {"HSV per pixel", "HSV per frame", "cached"};
+    int failures = 0;
+    printf("palette: ns per fading frame\n");
+    for (int s=1;s<NUM_STRIP_SIZES;s++) {
+        printf("  %3d LEDs", STRIP_SIZES[s]);
+        uint32_t checksums[NUM_PALETTE_PATHS];
+        for (int path=0;path<NUM_PALETTE_PATHS;path++) {
+            double ns = benchPalettePath(path, STRIP_SIZES[s], &checksums[path]);
+            printf("  %s %7.1f ns", PATH_NAMES[path], ns);
+        }
+        const bool same = checksums[PALETTE_CACHED] == checksums[PALETTE_PER_FRAME];
+        if (!same) failures++;
+        printf(", cached frames %s\n", same ? "same" : "DIFFERENT");
+    }
+    return failures;
+}
+
+/**
+ * visual steps of the fade modes at PWR_LOW, one cycle in red: the distinct
+ * red levels of the old 8 bit path, sin8() scaled by the brightness value
+ * before the color, against the distinct 16 bit levels of the engine, which
+ * dithering shows as averages. also the largest error of the dithered output
+ * against the 16 bit level, summed over the cycle, in 1/256 steps.
+ */
+static void benchFade() {
+    const uint8_t brightnessVal = 80;
+    printf("fade: visual steps per cycle at brightness %d, 8 bit/16 bit dithered\n", brightnessVal);
+    const int modes[] = {RGBMODE_SINGLEFADE, RGBMODE_DOUBLEFADE};
+    for (int m=0;m<2;m++) {
+        const AnimationMode& mode = RGB_MODES[modes[m]];
+        bool seen8[256] = {false};
+        static bool seen16[65536];
+        memset(seen16, 0, sizeof(seen16));
+        int steps8 = 0, steps16 = 0;
+        long drift = 0, worstDrift = 0;
+        AnimationEngine engine;
+        engine.setMode(&mode);
+        const CRGB color = paletteColor(0, brightnessVal);
+        for (int k=0;k<mode.numKeyframes;k++) {
+            const Keyframe& keyframe = mode.keyframes[k];
+            for (int i=0;i<keyframe.steps;i++) {
+                const uint8_t theta = i * 64 / keyframe.steps + (keyframe.type == KEYFRAME_RAMPDOWN ? 64 : 0);
+                const uint8_t level8 = keyframe.type == KEYFRAME_HOLD ? 255 : keyframe.type == KEYFRAME_OFF ? 0 : sin8(theta);
+                const uint8_t red8 = paletteColor(0, scale8(level8, brightnessVal)).r;
+                if (!seen8[red8]) steps8++;
+                seen8[red8] = true;
+                const uint16_t level = engine.step();
+                const uint16_t red16 = ((uint32_t) color.r * (level + 1)) >> 8;
+                if (!seen16[red16]) steps16++;
+                seen16[red16] = true;
+                drift += engine.dither(color, level).r * 256 - red16;
+                if (drift > worstDrift) worstDrift = drift;
+                if (-drift > worstDrift) worstDrift = -drift;
+            }
+        }
+        printf("  %-13s %3d/%4d, dithering off by at most %ld/256\n", MODE_NAMES[modes[m]], steps8, steps16, worstDrift);
+    }
+}
+
+/**
+ * button loop cost and click detection on replayed bounce traces.
+ * each trace is a train of single and double clicks with contact bounce on
+ * every edge, while the loop is stalled now and then the way a long
+ * FastLED.show() or a flash write stalls it.
+ */
+static const int BENCH_BTN_PIN = 40;
+static InterruptButton benchButton(BENCH_BTN_PIN);
+static int benchSingles;
+static int benchDoubles;
+
+static void benchButtonChange() {
+    benchButton.changeInterruptFunc();
+}
+
+static void benchButtonSingle() {
+    benchSingles++;
+}
+
+static void benchButtonDouble() {
+    benchDoubles++;
+}
+
+static uint32_t benchRandom(uint32_t& seed, uint32_t range) {
+    seed = seed * 1664525UL + 1013904223UL;
+    return (seed >> 8) % range;
+}
+
+/**
+ * flash timing with loop delays injected: the engine is updated every 5 ms
+ * frame for 10 simulated minutes, and 1 in 20 frames stalls the loop for up
+ * to 150 ms, the way a slow show() or an autosave does. a flash is counted
+ * when the LEDs come on; it is late by the time since it was due. the flash
+ * frequency, from the first flashes of the cycles over the whole run, has to
+ * stay within 0.1% and no flash may be later than the longest stall plus a frame.
+ */
+static int benchAnimationTiming() {
+    const unsigned long STALL_MILLIS = 150;
+    int failures = 0;
+    printf("animation timing: flashes under loop stalls of up to %lu ms\n", STALL_MILLIS);
+    const int modes[] = {RGBMODE_SINGLEFLASH, RGBMODE_DOUBLEFLASH};
+    for (int m=0;m<2;m++) {
+        const AnimationMode& mode = RGB_MODES[modes[m]];
+        // when in the cycle each flash is due
+        unsigned long flashDue[MAX_KEYFRAMES];
+        int flashes = 0;
+        unsigned long cycleMillis = 0;
+        for (int k=0;k<mode.numKeyframes;k++) {
+            if (mode.keyframes[k].type == KEYFRAME_HOLD) flashDue[flashes++] = cycleMillis;
+            cycleMillis += (unsigned long) mode.keyframes[k].steps * mode.stepMillis;
+        }
+        AnimationEngine engine;
+        Palette palette(paletteColor);
+        palette.update(BENCH_COLORS, 1, BENCH_BRIGHTNESS);
+        nativeSetMicros(0);
+        engine.setMode(&RGB_MODES[modes[m]]);
+        uint32_t seed = 7;
+        bool on = false;
+        unsigned long shown = 0, worstLate = 0, totalLate = 0;
+        unsigned long firstCycle = 0, lastCycle = 0, cycles = 0;
+        while (millis() < 600000) {
+            if (engine.update(palette.getColors(), palette.getNumColors())) {
+                engine.render(frame, 1);
+                const bool lit = frame[0] != CRGB(0, 0, 0);
+                if (lit && !on) {
+                    const unsigned long phase = millis() % cycleMillis;
+                    int flash = flashes - 1;
+                    while (flash && flashDue[flash] > phase) flash--;
+                    const unsigned long late = phase - flashDue[flash];
+                    if (late > worstLate) worstLate = late;
+                    totalLate += late;
+                    shown++;
+                    if (!flash) {
+                        // cycles since the last first flash seen, some may have been skipped by a stall
+                        if (!firstCycle && !lastCycle) firstCycle = millis();
+                        else cycles += (millis() - lastCycle + cycleMillis / 2) / cycleMillis;
+                        lastCycle = millis();
+                    }
+                }
+                on = lit;
+            }
+            nativeAdvanceMicros(FRAME_MICROS);
+            if (!benchRandom(seed, 20)) nativeAdvanceMicros(benchRandom(seed, STALL_MILLIS * 1000));
+        }
+        const double hz = cycles * 1000.0 / (lastCycle - firstCycle);
+        unsigned long due = 0;
+        for (int flash=0;flash<flashes;flash++) due += (600000 - flashDue[flash] + cycleMillis - 1) / cycleMillis;
+        const double nominal = 1000.0 / cycleMillis;
+        const bool ok = std::fabs(hz - nominal) <= nominal / 1000 && worstLate <= STALL_MILLIS + FRAME_MICROS / 1000;
+        if (!ok) failures++;
+        printf("  %-13s %.4f Hz of %.4f, %lu of %lu flashes, %.1f ms late on average, at most %lu ms: %s\n",
+            MODE_NAMES[modes[m]], hz, nominal, shown, due, (double) totalLate / shown,
+            worstLate, ok ? "ok" : "OUT OF TOLERANCE");
+    }
+    return failures;
+}
+
+static unsigned long benchTime;
+static bool benchStalls;
+static unsigned long benchStallUntil;
+static unsigned long benchLoops;
+static double benchLoopNanos;
+
+/**
+ * run the simulation until a point in time, one loop() per ms unless stalled
+ */
+static void benchRunUntil(unsigned long time, uint32_t& seed) {
+    while (benchTime < time) {
+        benchTime += 100;
+        nativeSetMicros(benchTime);
+        if (benchTime % 1000) continue;
+        if (benchTime < benchStallUntil) continue;
+        // 1 in 50 loops stalls for up to 200 ms
+        if (benchStalls && !benchRandom(seed, 50)) benchStallUntil = benchTime + benchRandom(seed, 200000);
+        double start = nowNanos();
+        benchButton.loop();
+        benchLoopNanos += nowNanos() - start;
+        benchLoops++;
+    }
+}
+
+/**
+ * move the pin to a level with up to 6 bounces within the first 5 ms
+ */
+static void benchEdge(int level, uint32_t& seed) {
+    int bounces = benchRandom(seed, 7);
+    unsigned long end = benchTime + 5000;
+    for (int i=0;i<bounces;i++) {
+        nativeSetPin(BENCH_BTN_PIN, level);
+        benchRunUntil(benchTime + 100 + benchRandom(seed, 600), seed);
+        nativeSetPin(BENCH_BTN_PIN, !level);
+        benchRunUntil(benchTime + 100 + benchRandom(seed, 600), seed);
+    }
+    nativeSetPin(BENCH_BTN_PIN, level);
+    if (benchTime < end) benchRunUntil(end, seed);
+}
+
+static int benchButtonLoop() {
+    nativeSetMicros(0);
+    benchStalls = true;
+    benchButton.begin(benchButtonChange);
+    benchButton.set1ShortPressFunc(benchButtonSingle);
+    benchButton.set2ShortPressFunc(benchButtonDouble);
+    const int traces = 8;
+    const int clicksPerTrace = 25;
+    int trueSingles = 0;
+    int trueDoubles = 0;
+    for (int t=0;t<traces;t++) {
+        uint32_t seed = t + 1;
+        for (int c=0;c<clicksPerTrace;c++) {
+            int clicks = benchRandom(seed, 2) + 1;
+            if (clicks == 1) trueSingles++;
+            else trueDoubles++;
+            for (int i=0;i<clicks;i++) {
+                // presses of 70 to 200 ms, 70 to 200 ms apart
+                benchEdge(LOW, seed);
+                benchRunUntil(benchTime + 65000 + benchRandom(seed, 130000), seed);
+                benchEdge(HIGH, seed);
+                benchRunUntil(benchTime + 65000 + benchRandom(seed, 130000), seed);
+            }
+            // wait out the multi-click window and any stall
+            benchRunUntil(benchTime + 1200000, seed);
+        }
+    }
+    printf("button: %.1f ns per loop(), %d of %d single and %d of %d double clicks detected\n",
+        benchLoopNanos / benchLoops, benchSingles, trueSingles, benchDoubles, trueDoubles);
+    return (benchSingles != trueSingles) + (benchDoubles != trueDoubles);
+}
+
+/**
+ * press-to-action latency of the gestures, with the firmware's handlers
+ * registered or with only the handler of the gesture
+ */
+static unsigned long benchActionTime;
+
+static void benchAction() {
+    benchActionTime = benchTime;
+}
+
+static void benchOtherAction() {
+}
+
+static void benchGesture(const char* name, int clicks, bool longPress, uint32_t& seed) {
+    unsigned long start = benchTime;
+    benchActionTime = 0;
+    for (int i=0;i<clicks;i++) {
+        benchEdge(LOW, seed);
+        benchRunUntil(benchTime + (longPress && i == clicks - 1 ? 1500000 : 100000), seed);
+        benchEdge(HIGH, seed);
+        benchRunUntil(benchTime + 100000, seed);
+    }
+    benchRunUntil(benchTime + 1200000, seed);
+    printf("  %-30s %4lu ms\n", name, (benchActionTime - start) / 1000);
+}
+
+static void benchButtonLatency() {
+    uint32_t seed = 1;
+    benchStalls = false;
+    printf("button: press-to-action latency\n");
+    benchButton.set1ShortPressFunc(benchAction);
+    benchButton.set2ShortPressFunc();
+    benchGesture("single click, alone", 1, false, seed);
+    benchButton.set2ShortPressFunc(benchOtherAction);
+    benchButton.set1LongPressFunc(benchOtherAction);
+    benchButton.set2LongPressFunc(benchOtherAction);
+    benchGesture("single click", 1, false, seed);
+    benchButton.set1ShortPressFunc(benchOtherAction);
+    benchButton.set2ShortPressFunc(benchAction);
+    benchGesture("double click", 2, false, seed);
+    benchButton.set2ShortPressFunc(benchOtherAction);
+    benchButton.set1LongPressFunc(benchAction);
+    benchGesture("long press", 1, true, seed);
+    benchButton.set1LongPressFunc(benchOtherAction);
+    benchButton.set2LongPressFunc(benchAction);
+    benchGesture("double long press", 2, true, seed);
+}
+
+/**
+ * ButtonGroup cost per button as buttons are added: every button is clicked
+ * in turn with contact bounce, and the interrupt handler and loop() are timed
+ */
+static const int BENCH_GROUP_PIN = 41;
+static ButtonGroup* benchGroup;
+static double benchIsrNanos;
+static unsigned long benchIsrs;
+static int benchGroupClicks;
+
+static void benchGroupChange() {
+    double start = nowNanos();
+    benchGroup->changeInterruptFunc();
+    benchIsrNanos += nowNanos() - start;
+    benchIsrs++;
+}
+
+static void benchGroupClick() {
+    benchGroupClicks++;
+}
+
+static void benchGroupTick(unsigned long us) {
+    for (unsigned long t=0;t<us;t+=1000) {
+        nativeAdvanceMicros(1000);
+        double start = nowNanos();
+        benchGroup->loop();
+        benchLoopNanos += nowNanos() - start;
+        benchLoops++;
+    }
+}
+
+static int benchButtonGroup() {
+    printf("button group: ns per button\n");
+    uint32_t seed = 1;
+    int failures = 0;
+    for (int numButtons=1;numButtons<=MAX_GROUP_BUTTONS;numButtons*=2) {
+        GroupButton buttons[MAX_GROUP_BUTTONS] = {41, 42, 43, 44, 45, 46, 47, 48};
+        ButtonGroup group(buttons, numButtons);
+        benchGroup = &group;
+        for (int i=0;i<numButtons;i++) buttons[i].set1ShortPressFunc(benchGroupClick);
+        nativeSetMicros(0);
+        group.begin(benchGroupChange);
+        benchIsrNanos = 0;
+        benchIsrs = 0;
+        benchLoopNanos = 0;
+        benchLoops = 0;
+        benchGroupClicks = 0;
+        const int clicks = 200;
+        for (int c=0;c<clicks;c++) {
+            int pin = BENCH_GROUP_PIN + c % numButtons;
+            for (int edge=0;edge<2;edge++) {
+                int level = edge ? HIGH : LOW;
+                for (int b=benchRandom(seed, 7);b>0;b--) {
+                    nativeSetPin(pin, level);
+                    nativeSetPin(pin, !level);
+                }
+                nativeSetPin(pin, level);
+                benchGroupTick(100000);
+            }
+        }
+        printf("  %d buttons: interrupt %5.1f ns, loop() %5.1f ns, %d of %d clicks detected\n", numButtons,
+            benchIsrNanos / benchIsrs / numButtons, benchLoopNanos / benchLoops / numButtons, benchGroupClicks, clicks);
+        if (benchGroupClicks != clicks) failures++;
+    }
+    return failures;
+}
+
+/**
+ * the firmware with the lights off: it should sleep until the button is
+ * pressed. each wake-up is a double click, which keeps the lights off.
+ */
+// BTN1_PIN of the firmware
+static const int BENCH_FIRMWARE_BTN_PIN = 2;
+static const unsigned long BENCH_SLEEP_MICROS = 5000000;
+static unsigned long benchAsleepMicros;
+static bool benchWoke;
+
+static void benchSleepHook(uint8_t pin) {
+    nativeAdvanceMicros(BENCH_SLEEP_MICROS);
+    benchAsleepMicros += BENCH_SLEEP_MICROS;
+    nativeSetPin(pin, LOW);
+    benchWoke = true;
+}
+
+static unsigned long benchFirmwareShows() {
+    unsigned long shows = FastLED.showCount;
+    for (int i=0;i<FastLED.count();i++) shows += FastLED[i].showCount;
+    return shows;
+}
+
+static void benchRunFirmware(unsigned long us) {
+    unsigned long end = micros() + us;
+    while (micros() < end) {
+        loop();
+        nativeAdvanceMicros(20);
+    }
+}
+
+static void benchPowerOff() {
+    nativeSetSerialEcho(false);
+    // from PWR_LOW through PWR_MED and PWR_HIGH to PWR_OFF
+    for (int i=0;i<3;i++) {
+        nativeSetPin(BENCH_FIRMWARE_BTN_PIN, LOW);
+        benchRunFirmware(80000);
+        nativeSetPin(BENCH_FIRMWARE_BTN_PIN, HIGH);
+        benchRunFirmware(600000);
+    }
+    nativeSleepHook = benchSleepHook;
+    benchAsleepMicros = 0;
+    int wakes = 0;
+    unsigned long wakeToFrame = 0;
+    unsigned long start = micros();
+    while (micros() - start < 30000000) {
+        loop();
+        nativeAdvanceMicros(20);
+        if (!benchWoke) continue;
+        benchWoke = false;
+        wakes++;
+        unsigned long wakeTime = micros();
+        unsigned long shows = benchFirmwareShows();
+        while (benchFirmwareShows() == shows) {
+            loop();
+            nativeAdvanceMicros(20);
+        }
+        wakeToFrame += micros() - wakeTime;
+        benchRunFirmware(80000 - (micros() - wakeTime));
+        nativeSetPin(BENCH_FIRMWARE_BTN_PIN, HIGH);
+        benchRunFirmware(100000);
+        nativeSetPin(BENCH_FIRMWARE_BTN_PIN, LOW);
+        benchRunFirmware(80000);
+        nativeSetPin(BENCH_FIRMWARE_BTN_PIN, HIGH);
+    }
+    nativeSleepHook = NULL;
+    nativeSetSerialEcho(true);
+    printf("power off: asleep %.1f%% of %lu s, %d wake-ups, %lu us from wake-up to the next frame\n",
+        benchAsleepMicros * 100.0 / (micros() - start), (micros() - start) / 1000000, wakes, wakes ? wakeToFrame / wakes : 0);
+}
+
+/**
+ * frame timing with the battery sampled in the background, not at all, and
+ * by a blocking analogRead() in every loop, then a pack drained from 12 V to
+ * 9.3 V over a minute and put on a charger
+ */
+static const int BENCH_BATTERY_PIN = A0;
+// ADC counts per V through the 100k over 47k divider
+static const double BENCH_COUNTS_PER_VOLT = 1023 / 15.638;
+// an AVR conversion at the default ADC clock
+static const unsigned long BENCH_ANALOG_READ_MICROS = 112;
+
+static void benchFrameJitter(const char* name, bool sampler, bool blocking) {
+    if (sampler) adcSampler.begin();
+    else adcSampler.end();
+    unsigned long loops = 0;
+    unsigned long jitter = 0;
+    unsigned long lastShow = 0;
+    unsigned long shows = benchFirmwareShows();
+    double elapsed = 0;
+    unsigned long end = micros() + 10000000;
+    while (micros() < end) {
+        double start = nowNanos();
+        loop();
+        elapsed += nowNanos() - start;
+        loops++;
+        if (blocking) {
+            analogRead(BENCH_BATTERY_PIN);
+            nativeAdvanceMicros(BENCH_ANALOG_READ_MICROS);
+        }
+        if (benchFirmwareShows() != shows) {
+            shows = benchFirmwareShows();
+            // shows land on the frame grid, late by the jitter
+            unsigned long late = (micros() - lastShow + FRAME_MICROS / 2) % FRAME_MICROS;
+            late = late > FRAME_MICROS / 2 ? late - FRAME_MICROS / 2 : FRAME_MICROS / 2 - late;
+            if (lastShow && late > jitter) jitter = late;
+            lastShow = micros();
+        }
+        nativeAdvanceMicros(20);
+    }
+    printf("  %-22s %5.1f ns per loop(), frame jitter %4lu us\n", name, elapsed / loops, jitter);
+}
+
+static int benchBattery() {
+    nativeSetSerialEcho(false);
+    nativeSetAnalog(BENCH_BATTERY_PIN, 12.0 * BENCH_COUNTS_PER_VOLT);
+    printf("battery: loop cost and frame timing\n");
+    benchFrameJitter("not sampled", false, false);
+    benchFrameJitter("sampled in background", true, false);
+    benchFrameJitter("blocking analogRead", false, true);
+    adcSampler.begin();
+    benchRunFirmware(5000000);
+    uint16_t derated[BATTERY_MAX_STEPS];
+    uint8_t step = battery.getStep();
+    unsigned long start = micros();
+    while (micros() - start < 60000000) {
+        double volts = 12.0 - 2.7 * (micros() - start) / 60000000.0;
+        nativeSetAnalog(BENCH_BATTERY_PIN, volts * BENCH_COUNTS_PER_VOLT);
+        benchRunFirmware(10000);
+        if (battery.getStep() > step) derated[step++] = battery.getMillivolts();
+    }
+    benchRunFirmware(100000);
+    // front, side, rear
+    bool frontOff = !segments[0].channelSums[0] && !segments[0].channelSums[1] && !segments[0].channelSums[2];
+    bool rearOn = segments[2].channelSums[0];
+    nativeSetAnalog(BENCH_BATTERY_PIN, 12.4 * BENCH_COUNTS_PER_VOLT);
+    start = micros();
+    while (battery.getStep() && micros() - start < 60000000) benchRunFirmware(10000);
+    nativeSetSerialEcho(true);
+    printf("battery: derated at");
+    for (uint8_t i=0;i<step;i++) printf(" %u", derated[i]);
+    printf(" mV, reserve front %s rear %s, back to full %.1f s after charging\n",
+        frontOff ? "off" : "ON", rearOn ? "on" : "OFF", (micros() - start) / 1e6);
+    return !frontOff + !rearOn;
+}
+
+/**
+ * automatic brightness on a night ride past streetlights and into the dawn:
+ * brightness changes and config saves, and the cost of checkSensors()
+ */
+static const int BENCH_LDR_PIN = A1;
+
+static int benchLightSensor() {
+    nativeSetSerialEcho(false);
+    const byte brightness = configuration.curBrightness;
+    nativeSetAnalog(BENCH_LDR_PIN, 1023 / 20);
+    configuration.autoBrightness = 1;
+    benchRunFirmware(10000000);
+    const uint16_t sequence = configStore.getSequence();
+    byte level = requestedBrightness();
+    int streetlightChanges = 0;
+    unsigned long start = micros();
+    while (micros() - start < 60000000) {
+        // a streetlight every 8 s, passed in 1.5 s
+        bool lit = (micros() - start) % 8000000 < 1500000;
+        nativeSetAnalog(BENCH_LDR_PIN, lit ? 1023 * 7 / 10 : 1023 / 20);
+        benchRunFirmware(10000);
+        if (requestedBrightness() != level) streetlightChanges++;
+        level = requestedBrightness();
+    }
+    int dawnChanges = 0;
+    start = micros();
+    while (micros() - start < 60000000) {
+        nativeSetAnalog(BENCH_LDR_PIN, 1023 / 20 + (1023 * 3 / 4) * (micros() - start) / 60000000);
+        benchRunFirmware(10000);
+        if (requestedBrightness() != level) dawnChanges++;
+        level = requestedBrightness();
+    }
+    const int saves = configStore.getSequence() - sequence;
+    const bool kept = configuration.curBrightness == brightness;
+    double elapsed = 0;
+    const int calls = 100000;
+    for (int i=0;i<calls;i++) {
+        double t = nowNanos();
+        checkSensors();
+        elapsed += nowNanos() - t;
+        nativeAdvanceMicros(20);
+    }
+    configuration.autoBrightness = 0;
+    configuration.curBrightness = brightness;
+    nativeSetAnalog(BENCH_LDR_PIN, 0);
+    benchRunFirmware(10000000);
+    nativeSetSerialEcho(true);
+    printf("light sensor: %d brightness changes past streetlights, %d into the dawn ending at %s, %d saves, configured brightness %s, %.1f ns per checkSensors()\n",
+        streetlightChanges, dawnChanges, level == 0 ? "off" : "on", saves, kept ? "kept" : "CHANGED", elapsed / calls);
+    // streetlights are filtered out, and the sensor's level is never saved
+    return (streetlightChanges != 0) + (saves != 0) + !kept;
+}
+
+/**
+ * config store wear over many saves, and recovery from a power cut after
+ * every possible number of byte writes into a save. a save writes each byte
+ * of one slot at most once, so no cell may see more than one write per
+ * round of the ring.
+ */
+static const int BENCH_CONFIG_SIZE = 16;
+static const int BENCH_CONFIG_SLOTS = 32;
+
+static void benchEraseEEPROM() {
+    for (int i=0;i<EEPROM.length();i++) EEPROM.write(i, 0xFF);
+    memset(EEPROM.writeCounts, 0, sizeof(EEPROM.writeCounts));
+}
+
+static int benchConfigStore() {
+    uint8_t data[BENCH_CONFIG_SIZE];
+    uint8_t loaded[BENCH_CONFIG_SIZE];
+    benchEraseEEPROM();
+    ConfigStore store(BENCH_CONFIG_SIZE, BENCH_CONFIG_SLOTS);
+    store.begin("bench");
+    bool fresh = !store.load(loaded);
+    const int saves = 10000;
+    memset(data, 0, sizeof(data));
+    for (int i=0;i<saves;i++) {
+        // a setting changes with every save
+        data[i % 3] = i;
+        store.save(data);
+    }
+    unsigned long maxWrites = 0;
+    for (int i=0;i<EEPROM.length();i++) {
+        if (EEPROM.writeCounts[i] > maxWrites) maxWrites = EEPROM.writeCounts[i];
+    }
+    ConfigStore reloaded(BENCH_CONFIG_SIZE, BENCH_CONFIG_SLOTS);
+    bool intact = reloaded.load(loaded) && !memcmp(loaded, data, sizeof(data));
+    const unsigned long writeBound = (saves + BENCH_CONFIG_SLOTS - 1) / BENCH_CONFIG_SLOTS;
+    printf("config store: %d saves, at most %lu writes per EEPROM cell of %lu allowed, %s after reboot, %s on first boot\n",
+        saves, maxWrites, writeBound, intact ? "newest record loaded" : "WRONG RECORD", fresh ? "none" : "GARBAGE");
+    int failures = !intact + !fresh + (maxWrites > writeBound);
+
+    // power cut after each number of byte writes into a save of changed data
+    int recovered = 0;
+    int cuts = 0;
+    for (int cut=0;cut<=BENCH_CONFIG_SIZE + 4;cut++) {
+        uint8_t previous[BENCH_CONFIG_SIZE];
+        benchEraseEEPROM();
+        ConfigStore before(BENCH_CONFIG_SIZE, BENCH_CONFIG_SLOTS);
+        before.load(loaded);
+        for (int i=0;i<BENCH_CONFIG_SIZE;i++) previous[i] = i;
+        for (int i=0;i<BENCH_CONFIG_SLOTS + 3;i++) before.save(previous);
+        for (int i=0;i<BENCH_CONFIG_SIZE;i++) data[i] = 0xA0 + i;
+        EEPROM.writesUntilPowerCut = cut;
+        before.save(data);
+        EEPROM.writesUntilPowerCut = -1;
+        ConfigStore after(BENCH_CONFIG_SIZE, BENCH_CONFIG_SLOTS);
+        bool ok = after.load(loaded);
+        if (ok && (!memcmp(loaded, previous, sizeof(loaded)) || !memcmp(loaded, data, sizeof(loaded)))) recovered++;
+        cuts++;
+    }
+    printf("config store: %d of %d torn saves recovered to the previous or new config\n", recovered, cuts);
+    if (recovered != cuts) failures++;
+    return failures;
+}
+
+/**
+ * the current estimate from the engine's channel sums against rescanning the
+ * frame, and the limited frame against the budget, for every mode on a
+ * 300 LED side strip next to 20 LED front and rear lights
+ */
+static int benchPowerLimit() {
+    static CRGB lights[20];
+    int failures = 0;
+    fill_solid(lights, 20, CRGB(255, 255, 255));
+    PowerLimiter limiter(2000);
+    limiter.setOutputScale(TypicalLEDStrip, BENCH_BRIGHTNESS);
+    printf("power limit: ns per estimate incremental/rescan, peak demand mA, frames over budget\n");
+    for (int mode=0;mode<NUM_MODES;mode++) {
+        LedSegment segments[2] = {
+            {lights, 20, 0, false, 0, {255 * 20, 255 * 20, 255 * 20}},
+            {frame, MAX_STRIP_SIZE, 0, false, 0, {0, 0, 0}},
+        };
+        AnimationEngine engine;
+        Palette palette(paletteColor);
+        palette.update(BENCH_COLORS, sizeof(BENCH_COLORS), BENCH_BRIGHTNESS);
+        fill_solid(ring, MAX_STRIP_SIZE, CRGB(0, 0, 0));
+        engine.setShiftBuffer(ring, MAX_STRIP_SIZE);
+        nativeSetMicros(0);
+        double incremental = 0;
+        double rescan = 0;
+        int wrong = 0;
+        int over = 0;
+        uint16_t peak = 0;
+        for (int i=0;i<BENCH_FRAMES;i++) {
+            engine.setMode(&RGB_MODES[mode]);
+            engine.update(palette.getColors(), palette.getNumColors());
+            engine.render(frame, MAX_STRIP_SIZE);
+            double start = nowNanos();
+            engine.getChannelSums(MAX_STRIP_SIZE, segments[1].channelSums);
+            incremental += nowNanos() - start;
+            start = nowNanos();
+            uint32_t sums[3] = {0, 0, 0};
+            for (int n=0;n<MAX_STRIP_SIZE;n++) {
+                for (uint8_t c=0;c<3;c++) sums[c] += frame[n][c];
+            }
+            rescan += nowNanos() - start;
+            if (memcmp(sums, segments[1].channelSums, sizeof(sums))) wrong++;
+            limiter.update(segments, 2, 1 << 1);
+            if (limiter.getDemandMilliamps() > peak) peak = limiter.getDemandMilliamps();
+            // the limited frame, rescanned
+            segments[1].rendered = true;
+            limiter.apply(segments[1], 1);
+            LedSegment limited = segments[1];
+            memset(limited.channelSums, 0, sizeof(limited.channelSums));
+            for (int n=0;n<MAX_STRIP_SIZE;n++) {
+                for (uint8_t c=0;c<3;c++) limited.channelSums[c] += frame[n][c];
+            }
+            PowerLimiter check(0xFFFF);
+            check.setOutputScale(TypicalLEDStrip, BENCH_BRIGHTNESS);
+            LedSegment limitedFrame[2] = {segments[0], limited};
+            check.update(limitedFrame, 2, 0);
+            if (check.getMilliamps() > limiter.getBudget()) over++;
+            nativeAdvanceMicros(FRAME_MICROS);
+        }
+        printf("  %-13s %6.1f/%7.1f ns %5u mA %d over%s\n", MODE_NAMES[mode], incremental / BENCH_FRAMES,
+            rescan / BENCH_FRAMES, peak, over, wrong ? " ESTIMATE DIFF" : "");
+        if (wrong || over) failures++;
+    }
+    return failures;
+}
+
+/**
+ * the firmware on simulated time, with the strip's wire time simulated as well
+ */
+static void benchFirmware() {
+    nativeSetSerialEcho(false);
+    nativeSetMicros(0);
+    FastLED.showMicrosPerLed = 30;
+    setup();
+    unsigned long loops = 0;
+    while (millis() < 10000) {
+        loop();
+        nativeAdvanceMicros(20);
+        loops++;
+    }
+    nativeSetSerialEcho(true);
+    unsigned long shows = FastLED.showCount;
+    for (int i=0;i<FastLED.count();i++) shows += FastLED[i].showCount;
+    printf("firmware: first light at %lu us, %lu loops, %lu controller shows in 10 s\n", firstLightMicros, loops, shows);
+}
+
+/**
+ * the host end of the control protocol: frames go into the firmware's serial
+ * input, and its serial output is fed to the client codec
+ */
+static bool benchResponded;
+
+static void benchClientWrite(const uint8_t* data, uint8_t len) {
+    nativeFeedSerial(data, len);
+}
+
+static ProtocolCodec benchClient(benchClientWrite);
+
+static void benchFirmwareWrite(const uint8_t* data, size_t len) {
+    for (size_t i=0;i<len;i++) {
+        if (benchClient.feed(data[i])) benchResponded = true;
+    }
+}
+
+/**
+ * hand a frame to the firmware and wait for the response.
+ * returns the firmware's time to handle it in ns, or -1 without a response.
+ */
+static double benchRoundTrip() {
+    benchResponded = false;
+    double start = nowNanos();
+    checkSerialCommands();
+    double elapsed = nowNanos() - start;
+    return benchResponded ? elapsed : -1;
+}
+
+static uint8_t benchStatus() {
+    ProtocolField field;
+    benchClient.rewindFields();
+    if (!benchClient.nextField(field) || field.id != FIELD_STATUS) return 0xFF;
+    return field.value[0];
+}
+
+static uint8_t benchSetPower(uint8_t& seq, uint8_t level) {
+    benchClient.beginFrame(++seq, CMD_SET);
+    benchClient.addField(FIELD_POWER, level);
+    benchClient.endFrame();
+    return benchRoundTrip() < 0 ? 0xFF : benchStatus();
+}
+
+/**
+ * power off and back on over the link: the firmware has to stay awake while
+ * the host is in control, as only the button wakes it, and sleep once the
+ * link has gone quiet
+ */
+// CONTROL_LINK_TIME of the firmware
+static const unsigned long BENCH_LINK_MICROS = 10000000;
+static int benchLinkSleeps;
+
+static void benchLinkSleepHook(uint8_t) {
+    nativeAdvanceMicros(BENCH_SLEEP_MICROS);
+    benchLinkSleeps++;
+}
+
+static int benchRemotePower(uint8_t& seq) {
+    int failures = 0;
+    nativeSleepHook = benchLinkSleepHook;
+    benchLinkSleeps = 0;
+    if (benchSetPower(seq, 0) != STATUS_OK) failures++;
+    benchRunFirmware(BENCH_LINK_MICROS / 2);
+    const bool awake = !benchLinkSleeps;
+    if (benchSetPower(seq, 2) != STATUS_OK) failures++;
+    benchRunFirmware(100000);
+    // front, side, rear
+    const bool relit = segments[0].channelSums[0];
+    if (benchSetPower(seq, 0) != STATUS_OK) failures++;
+    benchRunFirmware(BENCH_LINK_MICROS + 1000000);
+    const bool slept = benchLinkSleeps;
+    nativeSleepHook = NULL;
+    printf("protocol: powered off over the link, %s while it was up, %s over the link, %s once it went quiet\n",
+        awake ? "awake" : "ASLEEP", relit ? "back on" : "NOT back on", slept ? "asleep" : "still AWAKE");
+    return failures + !awake + !relit + !slept;
+}
+
+static int benchProtocol() {
+    nativeSetSerialEcho(false);
+    nativeSerialTxHook = benchFirmwareWrite;
+    ledsConfig saved = configuration;
+    const uint8_t savedPreset = presets.getActive();
+    int failures = 0;
+    uint8_t seq = 0;
+
+    // a batch of fields, read back
+    const uint8_t palette[] = {0, 4, 7};
+    benchClient.beginFrame(++seq, CMD_SET);
+    benchClient.addField(FIELD_PRESET, 2);
+    benchClient.addField(FIELD_POWER, 3);
+    benchClient.addField(FIELD_RGBMODE, 5);
+    benchClient.addField(FIELD_PALETTE, palette, sizeof(palette));
+    benchClient.endFrame();
+    if (benchRoundTrip() < 0 || benchStatus() != STATUS_OK || benchClient.getSequence() != seq) failures++;
+    benchClient.beginFrame(++seq, CMD_GET);
+    benchClient.endFrame();
+    if (benchRoundTrip() < 0 || benchStatus() != STATUS_OK) failures++;
+    ProtocolField field;
+    int matched = 0;
+    while (benchClient.nextField(field)) {
+        if (field.id == FIELD_PRESET && field.value[0] == 2) matched++;
+        if (field.id == FIELD_POWER && field.value[0] == 3) matched++;
+        if (field.id == FIELD_RGBMODE && field.value[0] == 5) matched++;
+        if (field.id == FIELD_PALETTE && field.len == sizeof(palette) && !memcmp(field.value, palette, sizeof(palette))) matched++;
+    }
+    if (matched != 4) failures++;
+
+    // a bad value rejects the whole batch
+    benchClient.beginFrame(++seq, CMD_SET);
+    benchClient.addField(FIELD_POWER, 0);
+    benchClient.addField(FIELD_MODE, 7);
+    benchClient.endFrame();
+    if (benchRoundTrip() < 0 || benchStatus() != STATUS_BAD_VALUE || configuration.curBrightness != 3) failures++;
+
+    // line noise and a corrupted frame are dropped, the next frame gets through
+    const uint8_t noise[] = {'x', PROTOCOL_SYNC, 60, 0x13, PROTOCOL_SYNC, PROTOCOL_VERSION, 2, 9, CMD_PING, 0x00, 0x00};
+    nativeFeedSerial(noise, sizeof(noise));
+    if (benchRoundTrip() >= 0) failures++;
+    nativeAdvanceMicros(PROTOCOL_TIMEOUT * 1000UL);
+    if (benchRoundTrip() >= 0) failures++;
+    benchClient.beginFrame(++seq, CMD_PING);
+    benchClient.endFrame();
+    if (benchRoundTrip() < 0 || benchStatus() != STATUS_OK) failures++;
+
+    // throughput, alternating batches and full reads
+    const int commands = 20000;
+    double total = 0;
+    unsigned long wireBytes = 0;
+    for (int i=0;i<commands;i++) {
+        benchClient.beginFrame(++seq, i & 1 ? CMD_GET : CMD_SET);
+        if (!(i & 1)) {
+            const uint8_t colors[MAX_PRESET_COLORS] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+            benchClient.addField(FIELD_POWER, i % 4);
+            benchClient.addField(FIELD_MODE, 1);
+            benchClient.addField(FIELD_RGBMODE, i % 7);
+            benchClient.addField(FIELD_PALETTE, colors, 1 + i % MAX_PRESET_COLORS);
+            benchClient.addField(FIELD_AUTO, 0);
+        }
+        benchClient.endFrame();
+        wireBytes += Serial.available();
+        double ns = benchRoundTrip();
+        if (ns < 0 || benchStatus() != STATUS_OK) failures++;
+        total += ns;
+    }
+    // frames coming in a byte at a time at 115200 baud after the link was idle,
+    // handled as the loop would while they come in
+    const int pacedFrames = 50;
+    int pacedAnswered = 0;
+    for (int i=0;i<pacedFrames;i++) {
+        nativeAdvanceMicros(2 * PROTOCOL_TIMEOUT * 1000UL);
+        checkSerialCommands();
+        benchClient.beginFrame(++seq, i & 1 ? CMD_PING : CMD_SET);
+        if (!(i & 1)) {
+            benchClient.addField(FIELD_POWER, i % 4);
+            benchClient.addField(FIELD_PALETTE, palette, sizeof(palette));
+        }
+        benchClient.endFrame();
+        uint8_t bytes[PROTOCOL_MAX_BODY + PROTOCOL_OVERHEAD];
+        size_t len = 0;
+        while (Serial.available() && len < sizeof(bytes)) bytes[len++] = Serial.read();
+        benchResponded = false;
+        for (size_t k=0;k<len;k++) {
+            nativeFeedSerial(&bytes[k], 1);
+            checkSerialCommands();
+            nativeAdvanceMicros(87);
+        }
+        if (benchResponded && benchStatus() == STATUS_OK && benchClient.getSequence() == seq) pacedAnswered++;
+    }
+    if (pacedAnswered != pacedFrames) failures++;
+    failures += benchRemotePower(seq);
+
+    // the longest frame to parse and apply, a batch of every field with a full palette.
+    // the best of many leaves out the host's scheduling, the worst shows it
+    double best = 1e9;
+    double worst = 0;
+    for (int i=0;i<1000;i++) {
+        const uint8_t colors[MAX_PRESET_COLORS] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+        benchClient.beginFrame(++seq, CMD_SET);
+        benchClient.addField(FIELD_PRESET, 1);
+        benchClient.addField(FIELD_POWER, 2);
+        benchClient.addField(FIELD_MODE, 1);
+        benchClient.addField(FIELD_RGBMODE, 4);
+        benchClient.addField(FIELD_PALETTE, colors, MAX_PRESET_COLORS);
+        benchClient.addField(FIELD_AUTO, 0);
+        benchClient.endFrame();
+        double ns = benchRoundTrip();
+        if (ns < 0 || benchStatus() != STATUS_OK) failures++;
+        if (ns < best) best = ns;
+        if (ns > worst) worst = ns;
+    }
+    nativeSerialTxHook = NULL;
+    configuration = saved;
+    presets.setActive(savedPreset);
+    nativeSetSerialEcho(true);
+    printf("protocol: %d failures, %.0f commands/s handled, longest frame %.0f ns at best and %.0f ns at worst of 1000, %lu bytes per command, %.0f commands/s at 115200 baud\n",
+        failures, commands / (total / 1e9), best, worst, wireBytes / commands, 11520.0 / ((double) wireBytes / commands));
+    printf("protocol: %d of %d frames answered when paced at 115200 baud after an idle link\n", pacedAnswered, pacedFrames);
+    return failures;
+}
+
+/**
+ * the host end of frame streaming: frames go out at the line rate into a
+ * serial input that holds SERIAL_RX_BUFFER bytes, like the AVR core's, and
+ * bytes that arrive while it is full are lost. The bytes due by now are
+ * delivered whenever the firmware looks at Serial, which is when the
+ * receive interrupt would have, and showing a frame takes as long as the
+ * streamed strip.
+ */
+#define SERIAL_RX_BUFFER 64
+
+static uint8_t benchStreamFrame[STREAM_HEADER_SIZE + 3 * 300 + STREAM_TRAILER_SIZE];
+static uint16_t benchStreamLeds;
+static size_t benchStreamSize;
+static size_t benchStreamSent;
+static uint32_t benchStreamFrames;
+static unsigned long long benchByteNanos;
+static unsigned long long benchGapNanos;
+static unsigned long long benchNextByte;
+static unsigned long benchBytesLost;
+
+static size_t buildStreamFrame(uint16_t numLeds, uint32_t frame) {
+    uint8_t* p = benchStreamFrame;
+    *p++ = 'A';
+    *p++ = 'd';
+    *p++ = 'a';
+    *p++ = (numLeds - 1) >> 8;
+    *p++ = (numLeds - 1) & 0xFF;
+    *p++ = benchStreamFrame[3] ^ benchStreamFrame[4] ^ 0x55;
+    uint8_t sum1 = 0, sum2 = 0;
+    for (int i=0;i<3 * numLeds;i++) {
+        *p = (frame * 7 + i * 13) & 0x3F;
+        sum1 += *p++;
+        sum2 += sum1;
+    }
+    *p++ = sum1;
+    *p++ = sum2;
+    return p - benchStreamFrame;
+}
+
+static void benchStreamReceive() {
+    while (benchNextByte <= micros() * 1000ULL) {
+        if (Serial.available() < SERIAL_RX_BUFFER) nativeFeedSerial(&benchStreamFrame[benchStreamSent], 1);
+        else benchBytesLost++;
+        benchNextByte += benchByteNanos;
+        if (++benchStreamSent == benchStreamSize) {
+            benchNextByte += benchGapNanos;
+            benchStreamSize = buildStreamFrame(benchStreamLeds, ++benchStreamFrames);
+            benchStreamSent = 0;
+        }
+    }
+}
+
+/**
+ * stream for a second of simulated time, pausing gapMicros after each frame.
+ * prints the frames shown per second against what the line could carry.
+ */
+static void benchStreamRun(unsigned long baud, uint16_t numLeds, unsigned long gapMicros) {
+    const unsigned long frameLeds = segments[0].numLeds + segments[1].numLeds + segments[2].numLeds;
+    FastLED.showMicrosPerLed = 30 * numLeds / frameLeds;
+    frameStream.resetStats();
+    benchStreamLeds = numLeds;
+    benchStreamSize = buildStreamFrame(numLeds, 0);
+    benchStreamSent = 0;
+    benchStreamFrames = 0;
+    benchByteNanos = 10000000000ULL / baud;
+    benchGapNanos = gapMicros * 1000ULL;
+    benchBytesLost = 0;
+    const unsigned long long start = micros();
+    benchNextByte = start * 1000;
+    nativeSerialRxHook = benchStreamReceive;
+    while (micros() - start < 1000000) {
+        loop();
+        nativeAdvanceMicros(5);
+    }
+    nativeSerialRxHook = NULL;
+    const double lineFps = 1e9 / (benchStreamSize * benchByteNanos + benchGapNanos);
+    printf("  %7lu baud %3u LEDs gap %4lu us: %4lu fps of %4.0f, %lu dropped, %lu late, %lu bytes lost\n",
+        baud, numLeds, gapMicros, frameStream.getFramesReceived(), lineFps,
+        frameStream.getFramesDropped(), frameStream.getFramesLate(), benchBytesLost);
+    // let the stream go idle, back to the rendered lights
+    while (Serial.available()) Serial.read();
+    for (int i=0;i<25000 && streaming;i++) {
+        loop();
+        nativeAdvanceMicros(100);
+    }
+}
+
+static int benchStream() {
+    nativeSetSerialEcho(false);
+    const unsigned int savedShowMicros = FastLED.showMicrosPerLed;
+    printf("stream: frames shown per second of streaming, pausing for the show after each frame\n");
+    const unsigned long bauds[] = {1000000, 2000000};
+    const uint16_t strips[] = {12, 60, 150, 300};
+    for (int b=0;b<2;b++) {
+        for (int i=0;i<4;i++) benchStreamRun(bauds[b], strips[i], 30 * strips[i] + 100);
+    }
+    printf("  back to back, without pausing for the show:\n");
+    benchStreamRun(2000000, 150, 0);
+
+    // a corrupted frame isn't shown
+    unsigned long shows = FastLED[0].showCount;
+    frameStream.resetStats();
+    size_t frameSize = buildStreamFrame(12, 1);
+    benchStreamFrame[10] ^= 1;
+    nativeFeedSerial(benchStreamFrame, frameSize);
+    checkSerialCommands();
+    const bool rejected = frameStream.getFramesDropped() == 1 && FastLED[0].showCount == shows;
+    printf("  corrupted frame %s\n", rejected ? "dropped" : "SHOWN");
+    for (int i=0;i<25000 && streaming;i++) {
+        loop();
+        nativeAdvanceMicros(100);
+    }
+    FastLED.showMicrosPerLed = savedShowMicros;
+    nativeSetSerialEcho(true);
+    return !rejected;
+}
+
+/**
+ * the deferred log on a 115200 baud link, with the lights on: the config dump
+ * is queued and written out by later loops, compared with writing it straight
+ * to Serial. then a burst of records overflows the log.
+ */
+static char benchLogText[1024];
+static size_t benchLogLength;
+
+static void benchLogWrite(const uint8_t* data, size_t len) {
+    for (size_t i=0;i<len && benchLogLength < sizeof(benchLogText) - 1;i++) benchLogText[benchLogLength++] = data[i];
+    benchLogText[benchLogLength] = 0;
+}
+
+/**
+ * one loop(), returns its time in us, or 0 if it showed a frame
+ */
+static unsigned long benchLogLoop() {
+    const unsigned long shows = benchFirmwareShows();
+    const unsigned long t = micros();
+    loop();
+    const unsigned long elapsed = micros() - t;
+    nativeAdvanceMicros(20);
+    return benchFirmwareShows() == shows ? elapsed : 0;
+}
+
+/**
+ * run the firmware until the log is empty and the link idle, or for at most a second.
+ * returns the longest loop() that didn't show a frame, in us.
+ */
+static unsigned long benchLogDrain() {
+    unsigned long longest = 0;
+    const unsigned long start = micros();
+    while ((!eventLog.empty() || Serial.availableForWrite() < NATIVE_SERIAL_TX_BUFFER) && micros() - start < 1000000) {
+        unsigned long elapsed = benchLogLoop();
+        if (elapsed > longest) longest = elapsed;
+    }
+    return longest;
+}
+
+static int benchLog() {
+    nativeSetSerialEcho(false);
+    nativeSetSerialBaud(115200);
+    nativeSerialTxHook = benchLogWrite;
+    // with the lights off, the loop would wait for the link to go idle before sleeping
+    const byte brightness = configuration.curBrightness;
+    // PWR_LOW
+    configuration.curBrightness = 1;
+    benchRunFirmware(100000);
+    benchLogDrain();
+    // the longest loop() without logging
+    unsigned long idleLongest = 0;
+    for (int i=0;i<500;i++) {
+        unsigned long elapsed = benchLogLoop();
+        if (elapsed > idleLongest) idleLongest = elapsed;
+    }
+
+    benchLogLength = 0;
+    unsigned long start = micros();
+    printConfiguration();
+    const unsigned long queueMicros = micros() - start;
+    const unsigned long longest = benchLogDrain();
+    const unsigned long drainMicros = micros() - start;
+    const size_t dumpLength = benchLogLength;
+
+    // the same text written straight to Serial
+    char dump[sizeof(benchLogText)];
+    memcpy(dump, benchLogText, dumpLength);
+    start = micros();
+    Serial.write((const uint8_t*) dump, dumpLength);
+    const unsigned long blockedMicros = micros() - start;
+    benchLogDrain();
+
+    // more records than the log holds, in one go
+    benchLogLength = 0;
+    const uint16_t dropped = eventLog.getDropped();
+    const int burst = 100;
+    double elapsed = 0;
+    for (int i=0;i<burst;i++) {
+        double t = nowNanos();
+        LOG_INFO(eventLog, F("bench record=% of %"), i, burst);
+        elapsed += nowNanos() - t;
+    }
+    benchLogDrain();
+    const uint16_t burstDropped = eventLog.getDropped() - dropped;
+    int lines = 0;
+    for (size_t i=0;i<benchLogLength;i++) lines += benchLogText[i] == '\n';
+    const bool reported = strstr(benchLogText, "log dropped=") != NULL;
+
+    configuration.curBrightness = brightness;
+    benchRunFirmware(100000);
+    nativeSerialTxHook = NULL;
+    nativeSetSerialBaud(0);
+    nativeSetSerialEcho(true);
+    printf("log: config dump of %u bytes queued in %lu us, out after %.1f ms, longest loop() without a frame %lu us, %lu us without logging\n",
+        (unsigned) dumpLength, queueMicros, drainMicros / 1000.0, longest, idleLongest);
+    printf("log: the same dump written straight to Serial blocks the loop for %.1f ms\n", blockedMicros / 1000.0);
+    printf("log: burst of %d records, %.1f ns per record, %d lines out, %u dropped, drops %s\n",
+        burst, elapsed / burst, lines, burstDropped, reported ? "reported" : "NOT REPORTED");
+    return !reported;
+}
+
+int main() {
+    int failures = benchRender();
+    failures += benchPalette();
+    benchFade();
+    failures += benchAnimationTiming();
+    failures += benchButtonLoop();
+    benchButtonLatency();
+    failures += benchButtonGroup();
+    failures += benchPowerLimit();
+    benchFirmware();
+    failures += benchBattery();
+    failures += benchLightSensor();
+    benchPowerOff();
+    failures += benchConfigStore();
+    failures += benchProtocol();
+    failures += benchStream();
+    failures += benchLog();
+    if (failures) printf("%d checks FAILED\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""
+Talks to the firmware over its binary control protocol on serial: pings it,
+reads its settings and changes them.
+
+    python3 tools/protoclient.py /dev/ttyUSB0 ping
+    python3 tools/protoclient.py /dev/ttyUSB0 get
+    python3 tools/protoclient.py /dev/ttyUSB0 get power palette
+    python3 tools/protoclient.py /dev/ttyUSB0 set preset=2 power=3 palette=0,4,7
+    python3 tools/protoclient.py /dev/ttyUSB0 set power=0 --stay 60
+
+With the lights off the firmware only stays awake for CONTROL_LINK_TIME
+(10 s) after the last control frame, as only the button wakes it from sleep.
+--stay keeps the link up with a PING every few seconds for that many seconds
+after the command, so the lights can be turned back on from another shell
+in the meantime. The status text the firmware prints goes to stderr.
+
+needs pyserial
+"""
+import argparse
+import sys
+import time
+
+import serial
+
+SYNC = 0xA5
+VERSION = 1
+MAX_BODY = 48
+RESPONSE = 0x80
+CMD_PING, CMD_GET, CMD_SET = 0, 1, 2
+STATUSES = ["ok", "bad version", "bad command", "bad field", "bad value"]
+FIELDS = ["status", "version", "power", "mode", "rgbmode", "palette", "preset", "auto"]
+# a PING this often keeps the link up, well within CONTROL_LINK_TIME
+KEEPALIVE_SECONDS = 4
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, as ProtocolCodec"""
+    crc = 0xFFFF
+    for c in data:
+        crc ^= c << 8
+        for _ in range(8):
+            crc = (crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1
+        crc &= 0xFFFF
+    return crc
+
+
+def frame(seq, command, fields=()):
+    body = bytes((seq, command))
+    for field_id, value in fields:
+        body += bytes((field_id, len(value))) + bytes(value)
+    checked = bytes((VERSION, len(body))) + body
+    crc = crc16(checked)
+    return bytes((SYNC,)) + checked + bytes((crc & 0xFF, crc >> 8))
+
+
+class Link:
+    """a serial port carrying control frames and the firmware's status text"""
+
+    def __init__(self, port):
+        self.port = port
+        self.seq = 0
+        self.rx = b""
+
+    def request(self, command, fields=(), timeout=1.0):
+        """send a frame, returns the fields of the response, status first, or None"""
+        self.seq = (self.seq + 1) & 0xFF
+        self.port.write(frame(self.seq, command, fields))
+        self.port.flush()
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            self.rx += self.port.read(self.port.in_waiting or 1)
+            response = self.parse()
+            if response is not None:
+                return response
+        return None
+
+    def parse(self):
+        """take the next frame out of the received bytes, passing text on to stderr"""
+        while self.rx:
+            start = self.rx.find(bytes((SYNC,)))
+            if start < 0:
+                start = len(self.rx)
+            sys.stderr.buffer.write(self.rx[:start])
+            sys.stderr.flush()
+            self.rx = self.rx[start:]
+            if len(self.rx) < 3:
+                return None
+            length = self.rx[2]
+            if self.rx[1] != VERSION or length < 2 or length > MAX_BODY:
+                self.rx = self.rx[1:]
+                continue
+            if len(self.rx) < 5 + length:
+                return None
+            checked, crc = self.rx[1:3 + length], self.rx[3 + length:5 + length]
+            if crc16(checked) != crc[0] | crc[1] << 8:
+                self.rx = self.rx[1:]
+                continue
+            self.rx = self.rx[5 + length:]
+            body = checked[2:]
+            if body[0] != self.seq or body[1] & RESPONSE == 0:
+                continue
+            fields = []
+            pos = 2
+            while pos + 2 <= len(body) and pos + 2 + body[pos + 1] <= len(body):
+                fields.append((body[pos], body[pos + 2:pos + 2 + body[pos + 1]]))
+                pos += 2 + body[pos + 1]
+            return fields
+        return None
+
+
+def field_id(name):
+    if name not in FIELDS[1:]:
+        raise argparse.ArgumentTypeError(f"unknown field {name}, one of {', '.join(FIELDS[1:])}")
+    return FIELDS.index(name)
+
+
+def assignment(text):
+    name, _, value = text.partition("=")
+    try:
+        return field_id(name), bytes(int(v, 0) for v in value.split(","))
+    except ValueError:
+        raise argparse.ArgumentTypeError(f"{text}: expected name=value or name=v1,v2,...")
+
+
+def show(fields):
+    """print the fields of a response, returns the status"""
+    if not fields or fields[0][0] != 0 or len(fields[0][1]) != 1:
+        print("malformed response")
+        return None
+    status = fields[0][1][0]
+    print(STATUSES[status] if status < len(STATUSES) else f"status {status}")
+    for field_id, value in fields[1:]:
+        name = FIELDS[field_id] if field_id < len(FIELDS) else f"field {field_id}"
+        print(f"  {name}={','.join(str(v) for v in value)}")
+    return status
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    parser.add_argument("command", choices=["ping", "get", "set"])
+    parser.add_argument("fields", nargs="*", help="names to get, or name=value to set")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--stay", type=float, default=0, help="seconds to keep the link up afterwards")
+    parser.add_argument("--no-reset-wait", action="store_true", help="don't wait for a board that resets on open")
+    args = parser.parse_args()
+    if args.command == "ping":
+        command, fields = CMD_PING, []
+    elif args.command == "get":
+        command, fields = CMD_GET, [(field_id(name), b"") for name in args.fields]
+    else:
+        command, fields = CMD_SET, [assignment(text) for text in args.fields]
+        if not fields:
+            parser.error("set needs at least one name=value")
+    with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+        if not args.no_reset_wait:
+            time.sleep(2)
+        port.reset_input_buffer()
+        link = Link(port)
+        response = link.request(command, fields)
+        if response is None:
+            print("no response")
+            return 1
+        status = show(response)
+        end = time.time() + args.stay
+        while time.time() < end:
+            time.sleep(min(KEEPALIVE_SECONDS, max(0, end - time.time())))
+            if link.request(CMD_PING) is None:
+                print("link lost")
+                return 1
+        return 0 if status == 0 else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
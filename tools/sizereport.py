@@ -0,0 +1,60 @@
+"""
+PlatformIO post-build script for the AVR envs. After linking it prints the
+RAM and flash the firmware uses, the largest RAM symbols, and how many more
+LEDs fit in the RAM that is left, at 3 bytes per LED after STACK_RESERVE
+bytes are kept for the stack.
+
+    [env:uno]
+    extra_scripts = post:tools/sizereport.py
+"""
+import os
+import subprocess
+
+Import("env")  # noqa: F821
+
+# bytes kept free for the stack, interrupts and FastLED.show()
+STACK_RESERVE = 256
+# RAM symbols listed
+TOP_SYMBOLS = 10
+BYTES_PER_LED = 3
+
+RAM_TYPES = "bBdD"
+FLASH_TYPES = "tTrR"
+
+
+def nm_path(env):
+    """avr-nm sits next to avr-gcc"""
+    cc = env.subst("$CC")
+    return os.path.join(os.path.dirname(cc), os.path.basename(cc).replace("gcc", "nm"))
+
+
+def symbols(env, elf):
+    """(size, type, name) of each sized symbol, smallest first"""
+    out = subprocess.check_output([nm_path(env), "--size-sort", "-S", "-C", elf], universal_newlines=True)
+    for line in out.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) == 4:
+            yield int(parts[1], 16), parts[2], parts[3]
+
+
+def size_report(source, target, env):
+    elf = str(target[0])
+    syms = list(symbols(env, elf))
+    ram_syms = [s for s in syms if s[1] in RAM_TYPES]
+    ram = sum(s[0] for s in ram_syms)
+    flash = sum(s[0] for s in syms if s[1] in FLASH_TYPES)
+    max_ram = int(env.BoardConfig().get("upload.maximum_ram_size", 0))
+
+    print("size report: %s" % os.path.basename(elf))
+    print("  flash %d bytes in symbols" % flash)
+    print("  ram   %d of %d bytes in globals" % (ram, max_ram))
+    print("  largest ram symbols:")
+    for size, _, name in sorted(ram_syms, reverse=True)[:TOP_SYMBOLS]:
+        print("  %6d  %s" % (size, name))
+    if max_ram:
+        headroom = max_ram - ram - STACK_RESERVE
+        print("  %d bytes left after a %d byte stack, room for %d more LEDs"
+              % (headroom, STACK_RESERVE, max(headroom, 0) // BYTES_PER_LED))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", size_report)  # noqa: F821
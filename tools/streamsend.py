@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""
+Streams test frames to the firmware over serial and reports the frame rate
+it achieved for each strip length.
+
+The firmware must be built with SERIAL_BAUD set to the same speed, e.g.
+build_flags = -DSERIAL_BAUD=2000000. After each run it goes idle for longer
+than the firmware's STREAM_IDLE_TIME, and the firmware prints what it got:
+    stream frames=<shown> dropped=<bad or stalled> late=<shown too late>
+
+    python3 tools/streamsend.py /dev/ttyUSB0 --baud 2000000 --leds 12 60 150 300
+
+needs pyserial
+"""
+import argparse
+import re
+import time
+
+import serial
+
+# time a WS2812 strip takes per LED, and the latch after it, in us
+SHOW_MICROS_PER_LED = 30
+SHOW_LATCH_MICROS = 100
+STATS = re.compile(rb"stream frames=(\d+) dropped=(\d+) late=(\d+)")
+
+
+def frame(num_leds, n):
+    """Adalight header, a moving gradient and the two running sums"""
+    hi, lo = (num_leds - 1) >> 8, (num_leds - 1) & 0xFF
+    pixels = bytes((n * 7 + i * 13) & 0x3F for i in range(3 * num_leds))
+    sum1 = sum2 = 0
+    for c in pixels:
+        sum1 = (sum1 + c) & 0xFF
+        sum2 = (sum2 + sum1) & 0xFF
+    return b"Ada" + bytes((hi, lo, hi ^ lo ^ 0x55)) + pixels + bytes((sum1, sum2))
+
+
+def run(port, num_leds, seconds, gap):
+    frames = [frame(num_leds, n) for n in range(64)]
+    sent = 0
+    start = time.perf_counter()
+    while time.perf_counter() - start < seconds:
+        port.write(frames[sent % len(frames)])
+        port.flush()
+        sent += 1
+        # give the strip time to show the frame before the next one comes in
+        until = time.perf_counter() + gap / 1e6
+        while time.perf_counter() < until:
+            pass
+    elapsed = time.perf_counter() - start
+    # wait for the firmware to go idle and print its counts
+    deadline = time.time() + 5
+    text = b""
+    while time.time() < deadline:
+        text += port.read(port.in_waiting or 1)
+        match = STATS.search(text)
+        if match:
+            shown, dropped, late = (int(x) for x in match.groups())
+            return sent, elapsed, shown, dropped, late
+    return sent, elapsed, None, None, None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    parser.add_argument("--baud", type=int, default=2000000)
+    parser.add_argument("--leds", type=int, nargs="+", default=[12, 60, 150, 300])
+    parser.add_argument("--seconds", type=float, default=5)
+    parser.add_argument("--gap", type=int, help="pause after each frame in us, by default the strip's show time")
+    args = parser.parse_args()
+    with serial.Serial(args.port, args.baud, timeout=0.1) as port:
+        # the board may reset on open
+        time.sleep(2)
+        port.reset_input_buffer()
+        for num_leds in args.leds:
+            gap = args.gap if args.gap is not None else SHOW_MICROS_PER_LED * num_leds + SHOW_LATCH_MICROS
+            line_fps = 1 / (len(frame(num_leds, 0)) * 10 / args.baud + gap / 1e6)
+            sent, elapsed, shown, dropped, late = run(port, num_leds, args.seconds, gap)
+            if shown is None:
+                print(f"{num_leds:4} LEDs: sent {sent / elapsed:6.1f} fps, no stats from the firmware")
+                continue
+            print(f"{num_leds:4} LEDs: sent {sent / elapsed:6.1f} fps of {line_fps:6.1f} the line carries, "
+                  f"shown {shown / elapsed:6.1f} fps, {dropped} dropped, {late} late")
+
+
+if __name__ == "__main__":
+    main()